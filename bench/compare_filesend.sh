@@ -0,0 +1,38 @@
+#!/bin/bash
+# 对比静态文件正文的三种发送方式(mmap/sendfile/splice)：4KB、1MB、1GB文件各压一轮，
+# 输出每秒请求数、吞吐量，以及服务器每发送1GB消耗的CPU时间
+# 用法: ./compare_filesend.sh [conns] [seconds] [其他服务器参数]
+# 需要先在上级目录make出myserver、在本目录make出http_bench
+cd "$(dirname "$0")"
+SERVER=${SERVER:-../myserver}
+PORT=${PORT:-8899}
+DATA=${DATA:-/tmp/filesend_bench}
+CONNS=${1:-8}
+SECONDS_RUN=${2:-10}
+shift 2 2>/dev/null
+HZ=$(getconf CLK_TCK)
+
+mkdir -p $DATA
+[ -f $DATA/4k.bin ] || head -c 4096 /dev/urandom > $DATA/4k.bin
+[ -f $DATA/1m.bin ] || head -c 1048576 /dev/urandom > $DATA/1m.bin
+[ -f $DATA/1g.bin ] || head -c 1073741824 /dev/urandom > $DATA/1g.bin
+cat $DATA/*.bin > /dev/null # 先读进页缓存，只比较发送路径
+
+for file in 4k.bin 1m.bin 1g.bin; do
+    for mode in mmap sendfile splice; do
+        $SERVER $PORT $DATA --filesend $mode "$@" > /dev/null 2>&1 &
+        pid=$!
+        sleep 0.5
+        before=$(awk '{print $14 + $15}' /proc/$pid/stat)
+        out=$(./http_bench 127.0.0.1 $PORT /$file $CONNS $SECONDS_RUN)
+        after=$(awk '{print $14 + $15}' /proc/$pid/stat)
+        kill $pid
+        wait $pid 2>/dev/null || true
+        echo "$out" | awk -v f=$file -v m=$mode -v t=$((after - before)) -v hz=$HZ -v s=$SECONDS_RUN '
+            /req\/s/ { rps = $2; mbs = $4 }
+            END {
+                gb = mbs * s / 1024
+                printf "%-8s %-9s req/s: %-8s MB/s: %-9s server cpu: %.2fs  cpu/GB: %.3fs\n", f, m, rps, mbs, t / hz, (gb > 0 ? t / hz / gb : 0)
+            }'
+    done
+done
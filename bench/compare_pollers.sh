@@ -0,0 +1,27 @@
+#!/bin/bash
+# 分别用epoll和io_uring后端启动服务器，用http_bench压同一个文件，对比每秒请求数和服务器CPU时间
+# 用法: ./compare_pollers.sh [path] [conns] [seconds] [其他服务器参数]
+# 需要先在上级目录make出myserver、在本目录make出http_bench
+cd "$(dirname "$0")"
+SERVER=${SERVER:-../myserver}
+ROOT=${ROOT:-../websource}
+PORT=${PORT:-8899}
+FILE=${1:-/index.html}
+CONNS=${2:-50}
+SECONDS_RUN=${3:-10}
+shift 3 2>/dev/null
+HZ=$(getconf CLK_TCK)
+
+for backend in epoll uring; do
+    $SERVER $PORT $ROOT --poller $backend "$@" > /dev/null 2>&1 &
+    pid=$!
+    sleep 0.5
+    # /proc/pid/stat第14、15列是用户态和内核态CPU时间(单位clock tick)
+    before=$(awk '{print $14 + $15}' /proc/$pid/stat)
+    echo "== $backend"
+    ./http_bench 127.0.0.1 $PORT $FILE $CONNS $SECONDS_RUN
+    after=$(awk '{print $14 + $15}' /proc/$pid/stat)
+    awk -v t=$((after - before)) -v hz=$HZ -v s=$SECONDS_RUN 'BEGIN { printf "server cpu: %.2fs (%.0f%%)\n", t / hz, t / hz / s * 100 }'
+    kill $pid
+    wait $pid 2>/dev/null || true
+done
@@ -0,0 +1,201 @@
+// 简单的HTTP长连接压测工具：单线程epoll驱动conns个keep-alive连接，
+// 每个连接收完一个响应就立刻发下一个请求，统计seconds秒内完成的请求数和吞吐量；
+// 给出depth时每个连接一次流水线发出depth个请求，收齐这批响应再发下一批
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct BenchConn
+{
+    int fd;
+    std::string in;         // 未处理完的响应数据
+    size_t sent;            // 当前请求已发出的字节数
+    long body_left;         // 正文还差多少字节，-1表示还在收响应头
+    int waiting;            // 本批请求还没收到的响应数
+};
+
+static std::string request;     // 一批请求，depth个同样的请求首尾相接
+static int depth = 1;
+static struct sockaddr_in server_addr;
+static long long done_requests = 0;
+static long long recv_bytes = 0;
+static long long errors = 0;
+
+static long long now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static int open_conn(int epfd, BenchConn &c)
+{
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c.fd < 0)
+        return -1;
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c.fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS)
+    {
+        close(c.fd);
+        return -1;
+    }
+    c.in.clear();
+    c.sent = 0;
+    c.body_left = -1;
+    c.waiting = depth;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = &c;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+static void reopen_conn(int epfd, BenchConn &c)
+{
+    ++errors;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, NULL);
+    close(c.fd);
+    open_conn(epfd, c);
+}
+
+// 尽量把当前请求写完，写完后只关心可读
+static bool flush_request(int epfd, BenchConn &c)
+{
+    while (c.sent < request.size())
+    {
+        ssize_t n = write(c.fd, request.data() + c.sent, request.size() - c.sent);
+        if (n < 0)
+            return errno == EAGAIN;
+        c.sent += n;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+    return true;
+}
+
+// 从已收到的数据里解析出完整的响应，返回false表示连接要重建
+static bool consume_response(int epfd, BenchConn &c)
+{
+    while (true)
+    {
+        if (c.body_left < 0)
+        {
+            size_t end = c.in.find("\r\n\r\n");
+            if (end == std::string::npos)
+                return true;
+            size_t pos = c.in.find("Content-length: ");
+            if (pos == std::string::npos || pos > end)
+                pos = c.in.find("Content-Length: ");
+            if (pos == std::string::npos || pos > end)
+                return false;
+            c.body_left = atol(c.in.c_str() + pos + 16);
+            c.in.erase(0, end + 4);
+        }
+        if ((long)c.in.size() < c.body_left)
+        {
+            c.body_left -= c.in.size();
+            c.in.clear();
+            return true;
+        }
+        c.in.erase(0, c.body_left);
+        c.body_left = -1;
+        ++done_requests;
+        if (--c.waiting > 0)
+            continue;
+        // 一批响应收齐，发下一批请求
+        c.sent = 0;
+        c.waiting = depth;
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = &c;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+        if (c.in.empty())
+            return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 6)
+    {
+        printf("./http_bench ip port path conns seconds [depth]\n");
+        return 1;
+    }
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_pton(AF_INET, argv[1], &server_addr.sin_addr);
+    int conn_num = atoi(argv[4]);
+    int seconds = atoi(argv[5]);
+    if (argc > 6)
+        depth = atoi(argv[6]) > 0 ? atoi(argv[6]) : 1;
+    std::string one = std::string("GET ") + argv[3] + " HTTP/1.1\r\nHost: " + argv[1] + "\r\nConnection: keep-alive\r\n\r\n";
+    for (int i = 0; i < depth; ++i)
+        request += one;
+
+    int epfd = epoll_create1(0);
+    std::vector<BenchConn> conns(conn_num);
+    for (int i = 0; i < conn_num; ++i)
+    {
+        if (open_conn(epfd, conns[i]) < 0)
+        {
+            perror("connect");
+            return 1;
+        }
+    }
+    std::vector<struct epoll_event> events(conn_num);
+    std::vector<char> buf(1 << 16);
+    long long start = now_ms();
+    long long deadline = start + seconds * 1000LL;
+    while (now_ms() < deadline)
+    {
+        int n = epoll_wait(epfd, events.data(), conn_num, 100);
+        for (int i = 0; i < n; ++i)
+        {
+            BenchConn &c = *static_cast<BenchConn*>(events[i].data.ptr);
+            if (events[i].events & EPOLLOUT)
+            {
+                if (!flush_request(epfd, c))
+                {
+                    reopen_conn(epfd, c);
+                    continue;
+                }
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                continue;
+            bool ok = true;
+            while (true)
+            {
+                ssize_t r = read(c.fd, buf.data(), buf.size());
+                if (r > 0)
+                {
+                    recv_bytes += r;
+                    c.in.append(buf.data(), r);
+                    continue;
+                }
+                if (r == 0 || errno != EAGAIN)
+                    ok = false;
+                break;
+            }
+            if (!consume_response(epfd, c) || !ok)
+                reopen_conn(epfd, c);
+        }
+    }
+    double elapsed = (now_ms() - start) / 1000.0;
+    printf("requests: %lld  errors: %lld  time: %.2fs\n", done_requests, errors, elapsed);
+    printf("req/s: %.0f  MB/s: %.2f\n", done_requests / elapsed, recv_bytes / elapsed / (1024 * 1024));
+    return 0;
+}
@@ -0,0 +1,139 @@
+// 查表微基准：同一组文件名和头部名字，分别用原来的做法(加锁懒初始化的unordered_map，
+// 先find再operator[]、按值返回string)和编译期完美哈希表查，报告每秒查找次数
+#include "../mimeType.h"
+#include "../httpHeaders.h"
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+
+static double now_sec()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 原来requestData里的MimeType，原样搬过来做对照
+static pthread_mutex_t old_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_map<std::string, std::string> old_mime;
+
+static std::string oldGetMime(const std::string &suffix)
+{
+    if (old_mime.size() == 0)
+    {
+        pthread_mutex_lock(&old_lock);
+        if (old_mime.size() == 0)
+        {
+            old_mime[".html"] = "text/html";
+            old_mime[".avi"] = "video/x-msvideo";
+            old_mime[".bmp"] = "image/bmp";
+            old_mime[".c"] = "text/plain";
+            old_mime[".doc"] = "application/msword";
+            old_mime[".gif"] = "image/gif";
+            old_mime[".gz"] = "application/x-gzip";
+            old_mime[".htm"] = "text/html";
+            old_mime[".ico"] = "application/x-ico";
+            old_mime[".jpg"] = "image/jpeg";
+            old_mime[".png"] = "image/png";
+            old_mime[".txt"] = "text/plain";
+            old_mime[".mp3"] = "audio/mp3";
+            old_mime["default"] = "text/html";
+        }
+        pthread_mutex_unlock(&old_lock);
+    }
+    if (old_mime.find(suffix) == old_mime.end())
+        return old_mime["default"];
+    else
+        return old_mime[suffix];
+}
+
+// 原来的调用方式：按第一个点截出后缀再查
+static size_t oldMime(const std::string &file_name)
+{
+    int dot_pos = file_name.find('.');
+    std::string filetype;
+    if (dot_pos < 0)
+        filetype = oldGetMime("default");
+    else
+        filetype = oldGetMime(file_name.substr(dot_pos));
+    return filetype.size();
+}
+
+static size_t newMime(const std::string &file_name)
+{
+    return MimeType::getMime(file_name).size();
+}
+
+static const char *file_names[] = {
+    "index.html", "static/css/site.css", "static/js/app.js", "images/logo.png", "images/photo.jpg",
+    "favicon.ico", "docs/manual.pdf", "media/clip.mp4", "fonts/inter.woff2", "data/report.json",
+    "download/archive.tar.gz", "readme", "hello.txt", "icons/sprite.svg", "audio/track.mp3", "old/page.htm",
+};
+
+static const char *header_names[] = {
+    "Host", "Connection", "User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Cookie",
+    "Referer", "sec-ch-ua", "sec-fetch-mode", "If-Modified-Since", "If-None-Match", "content-length",
+    "content-type", "Upgrade-Insecure-Requests", "X-Forwarded-For",
+};
+
+// 把名字一轮轮查seconds秒，返回每秒查找次数
+template <typename Fn>
+static double run(const std::string *names, size_t count, Fn fn, double seconds)
+{
+    long long lookups = 0;
+    size_t check = 0;
+    double start = now_sec();
+    double elapsed = 0;
+    while (elapsed < seconds)
+    {
+        for (int round = 0; round < 10000; ++round)
+        {
+            for (size_t i = 0; i < count; ++i)
+                check += fn(names[i]);
+        }
+        lookups += 10000LL * count;
+        elapsed = now_sec() - start;
+    }
+    if (check == 0) // 防止整个循环被优化掉
+        printf("nothing found\n");
+    return lookups / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    const size_t file_count = sizeof(file_names) / sizeof(file_names[0]);
+    const size_t header_count = sizeof(header_names) / sizeof(header_names[0]);
+    std::string files[file_count], headers[header_count];
+    for (size_t i = 0; i < file_count; ++i)
+        files[i] = file_names[i];
+    for (size_t i = 0; i < header_count; ++i)
+        headers[i] = header_names[i];
+
+    // 原来建在启动时的开放寻址表换成了完美哈希，头部这里只测新的；对照组是按小写名字查unordered_map
+    std::unordered_map<std::string, int> header_map;
+    for (int id = 0; id < HDR_COUNT; ++id)
+    {
+        std::string name(headerName(static_cast<HeaderId>(id)));
+        for (char &c : name)
+            c = tolower(c);
+        header_map[name] = id;
+    }
+    auto mapHeader = [&header_map](const std::string &name) {
+        std::string lower(name);
+        for (char &c : lower)
+            c = tolower(c);
+        auto it = header_map.find(lower);
+        return (size_t)(it == header_map.end() ? 1 : it->second + 2);
+    };
+    auto hashHeader = [](const std::string &name) { return (size_t)(lookupHeader(name) + 2); };
+
+    printf("%-8s %-14s %12.0f lookups/s\n", "mime", "unordered_map", run(files, file_count, oldMime, seconds));
+    printf("%-8s %-14s %12.0f lookups/s\n", "mime", "perfect hash", run(files, file_count, newMime, seconds));
+    printf("%-8s %-14s %12.0f lookups/s\n", "header", "unordered_map", run(headers, header_count, mapHeader, seconds));
+    printf("%-8s %-14s %12.0f lookups/s\n", "header", "perfect hash", run(headers, header_count, hashHeader, seconds));
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "chunkedDecoder.h"
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+ChunkedDecoder::ChunkedDecoder()
+{
+    reset();
+}
+
+void ChunkedDecoder::reset()
+{
+    state = CHUNK_SIZE;
+    chunk_left = 0;
+    line_len = 0;
+    trailer_len = 0;
+    digits = 0;
+    total = 0;
+}
+
+ssize_t ChunkedDecoder::decode(const char *buf, size_t len, const char *&data, size_t &data_len)
+{
+    data = NULL;
+    data_len = 0;
+    size_t pos = 0;
+    while (pos < len && state != CHUNK_DONE)
+    {
+        char c = buf[pos];
+        if (state == CHUNK_SIZE || state == CHUNK_EXT || state == CHUNK_SIZE_LF)
+        {
+            if (++line_len > MAX_CHUNK_LINE) // 块扩展不能无限长
+                return CHUNK_ERROR;
+        }
+        else if (state >= CHUNK_TRAILER)
+        {
+            if (++trailer_len > MAX_CHUNK_TRAILER)
+                return CHUNK_ERROR;
+        }
+        switch (state)
+        {
+        case CHUNK_SIZE:
+        {
+            int v = hexValue(c);
+            if (v >= 0)
+            {
+                if (++digits > 15) // 15位十六进制不会溢出size_t，再大的块也不可能是正常请求
+                    return CHUNK_ERROR;
+                chunk_left = chunk_left * 16 + v;
+            }
+            else if (digits == 0)
+                return CHUNK_ERROR;
+            else if (c == ';' || c == ' ' || c == '\t')
+                state = CHUNK_EXT;
+            else if (c == '\r')
+                state = CHUNK_SIZE_LF;
+            else
+                return CHUNK_ERROR;
+            break;
+        }
+        case CHUNK_EXT:
+            if (c == '\r')
+                state = CHUNK_SIZE_LF;
+            else if (c == '\n')
+                return CHUNK_ERROR;
+            break;
+        case CHUNK_SIZE_LF:
+            if (c != '\n')
+                return CHUNK_ERROR;
+            state = chunk_left == 0 ? CHUNK_TRAILER : CHUNK_DATA; // 大小为0的块是最后一块
+            line_len = 0;
+            digits = 0;
+            break;
+        case CHUNK_DATA:
+        {
+            // 一次交出buf里属于当前块的全部正文，交给调用者处理完再接着解码
+            size_t n = len - pos < chunk_left ? len - pos : chunk_left;
+            data = buf + pos;
+            data_len = n;
+            chunk_left -= n;
+            total += n;
+            if (chunk_left == 0)
+                state = CHUNK_DATA_CR;
+            return pos + n;
+        }
+        case CHUNK_DATA_CR:
+            if (c != '\r')
+                return CHUNK_ERROR;
+            state = CHUNK_DATA_LF;
+            break;
+        case CHUNK_DATA_LF:
+            if (c != '\n')
+                return CHUNK_ERROR;
+            state = CHUNK_SIZE;
+            break;
+        case CHUNK_TRAILER:
+            state = c == '\r' ? CHUNK_TRAILER_LF : CHUNK_TRAILER_LINE;
+            break;
+        case CHUNK_TRAILER_LINE:
+            if (c == '\n')
+                state = CHUNK_TRAILER;
+            break;
+        case CHUNK_TRAILER_LF:
+            if (c != '\n')
+                return CHUNK_ERROR;
+            state = CHUNK_DONE;
+            break;
+        default:
+            return CHUNK_ERROR;
+        }
+        ++pos;
+    }
+    return pos;
+}
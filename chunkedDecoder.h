@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+const size_t MAX_CHUNK_LINE = 4096;         // 块大小行(连同块扩展)的最大字节数
+const size_t MAX_CHUNK_TRAILER = 65536;     // 最后一块之后trailer部分的最大字节数
+const int CHUNK_ERROR = -1;                 // 格式错误
+
+/* Transfer-Encoding: chunked 请求体的增量解码器。
+   请求体分几次到达时从上次停下的状态接着解析，每个字节只看一次，不需要等整个请求体收齐；
+   decode()每次最多交出一段正文，正文就是调用者缓冲区里的视图，不拷贝。
+   块扩展和trailer都按规定跳过 */
+class ChunkedDecoder
+{
+private:
+    enum State
+    {
+        CHUNK_SIZE,         // 块大小的十六进制数字
+        CHUNK_EXT,          // 块扩展，跳过
+        CHUNK_SIZE_LF,      // 块大小行结尾的LF
+        CHUNK_DATA,         // 块的正文
+        CHUNK_DATA_CR,      // 正文后面的CRLF
+        CHUNK_DATA_LF,
+        CHUNK_TRAILER,      // 一行trailer的开头，空行表示请求体结束
+        CHUNK_TRAILER_LINE, // 一行trailer的其余部分，跳过
+        CHUNK_TRAILER_LF,   // 结尾空行的LF
+        CHUNK_DONE
+    };
+    State state;
+    size_t chunk_left;  // 当前块还没交出的正文字节数
+    size_t line_len;    // 当前块大小行已经看过的字节数
+    size_t trailer_len; // trailer已经看过的字节数
+    int digits;         // 块大小已经读到的十六进制位数
+    size_t total;       // 已经交出的正文总字节数
+
+public:
+    ChunkedDecoder();
+    void reset();
+    /* 从buf开头接着解码，返回用掉的字节数，格式错误返回CHUNK_ERROR。
+       用掉的字节里有正文时data/data_len指向其中的一段，否则data_len为0；
+       请求体结束(done())后buf里剩下的字节不再看，属于流水线上的下一个请求 */
+    ssize_t decode(const char *buf, size_t len, const char *&data, size_t &data_len);
+    bool done() const { return state == CHUNK_DONE; }
+    size_t bodySize() const { return total; }
+};
@@ -3,93 +3,156 @@
 #include "util.h"
 #include "log.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string.h>
-#include <queue>
+#include <unistd.h>
 #include <deque>
 
 int TIMER_TIME_OUT = 500;
-extern std::priority_queue<std::shared_ptr<mytimer>, std::deque<std::shared_ptr<mytimer>>, timerCmp> myTimerQueue;
 
-epoll_event* Epoll::events; //定义全局动态数组，记录每次轮询的活跃事件
-std::unordered_map<int, std::shared_ptr<requestData>> Epoll::fd2req; //哈希映射树上的结点，key=fd，value=请求对象
-int Epoll::epoll_fd = 0;
 const std::string Epoll::PATH = "/";
 
-// 创建epoll句柄（内核事件表）并初始化
-int Epoll::epoll_init(int maxevents, int listen_num)
+Epoll::Epoll():
+    poller(NULL),
+    max_events(0),
+    in_loop(false),
+    timer_fd(-1),
+    timer_armed(TIMER_NEVER),
+    timer_fired(false),
+    now_ms(monotonicMs()),
+    next_loop(0),
+    wakeup_fd(-1),
+    thread(0)
 {
-    epoll_fd = epoll_create(listen_num + 1); // 创建一个epoll树
-    if(epoll_fd == -1)
-        return -1;
+    pthread_mutex_init(&timer_lock, NULL);
+    pthread_mutex_init(&pending_lock, NULL);
+    timers.init(now_ms);
+}
 
+Epoll::~Epoll()
+{
+    if (wakeup_fd >= 0)
+        close(wakeup_fd);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    delete poller;
+    pthread_mutex_destroy(&timer_lock);
+    pthread_mutex_destroy(&pending_lock);
+}
+
+// 创建轮询器(epoll句柄或io_uring)并初始化
+int Epoll::epoll_init(int maxevents, int listen_num, const std::string &_backend)
+{
+    backend = _backend;
+    poller = Poller::newPoller(backend);
     //初始化事件数组，maxevents为最大关注socketfd数量
-    events = new epoll_event[maxevents];
+    if (poller->init(maxevents, listen_num) < 0)
+        return -1;
+    max_events = maxevents;
+
+    // 定时器的timerfd和连接一起监听，到期时本循环被叫醒
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+        return -1;
+    if (poller->add(timer_fd, makeToken(timer_fd, 0), EPOLLIN) < 0)
+        return -1;
+
+    // 连接表容量是进程能打开的最大fd数，fd直接作下标，槽位用到时才分配
+    conns.init(maxOpenFiles());
+    ready_reqs.reserve(maxevents);
     return 0;
 }
 
+// 监听描述符上树，监听fd不进连接表
+int Epoll::epoll_add_listener(int listen_fd)
+{
+    return poller->addListener(listen_fd, makeToken(listen_fd, 0));
+}
+
 // 注册新描述符
 // 参数：fd 要上树的fd， request 请求对象ev， events要监控的事件
 int Epoll::epoll_add(int fd, std::shared_ptr<requestData> request, __uint32_t events)
 {
-    struct epoll_event event;
-    event.data.fd = fd;
-    event.events = events;
-    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    if (fd < 0 || (size_t)fd >= conns.capacity()) // 超出连接表容量
     {
-        perror("epoll_add error");
+        fprintf(stderr, "epoll_add error: fd %d out of connection table\n", fd);
         return -1;
     }
-    fd2req[fd] = request; //记录该请求事件
+    ConnSlot &slot = conns.at(fd);
+    if (poller->addConn(fd, makeToken(fd, slot.gen + 1), events) < 0)
+        return -1;
+    ++slot.gen;
+    slot.req = request; //记录该请求事件
     return 0;
 }
 
-// 修改描述符状态，一般用于重置长连接
-int Epoll::epoll_mod(int fd, std::shared_ptr<requestData> request, __uint32_t events)
+// 修改描述符状态，一般用于重置长连接。请求对象一直留在连接表里，这里只重新布置事件
+int Epoll::epoll_mod(int fd, __uint32_t events)
+{
+    return poller->mod(fd, makeToken(fd, conns[fd].gen), events);
+}
+
+// 从轮询器中删除描述符
+int Epoll::epoll_del(int fd, __uint32_t events)
+{
+    ConnSlot &slot = conns[fd];
+    uint64_t token = makeToken(fd, slot.gen);
+    // 槽位先释放：即使fd已经因出错事件不在树上，连接表里也不能再留着它
+    ++slot.gen;
+    slot.req.reset();
+    return poller->del(fd, token); //将事件下树
+}
+
+int Epoll::send_output(int fd, std::deque<OutChunk> &chunks)
+{
+    return poller->send(fd, makeToken(fd, conns[fd].gen), chunks);
+}
+
+void Epoll::close_fd(int fd)
+{
+    poller->close(fd);
+}
+
+// 默认模式下直接重新放进线程池排队，此时连接不在树上(EPOLLONESHOT已消耗)，不会被两个线程同时处理；
+// 子reactor里放进deferred_reqs，本轮事件处理完后再处理，期间事件循环不阻塞等待
+int Epoll::deferRequest(std::shared_ptr<requestData> req)
 {
-    struct epoll_event event;
-    event.data.fd = fd;
-    event.events = events;
-    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+    if (in_loop)
     {
-        perror("epoll_mod error");
-        return -1;
+        deferred_reqs.push_back(req);
+        return 0;
     }
-    fd2req[fd] = request;
-    return 0;
+    return ThreadPool::threadpool_add(req);
 }
 
-// 从epoll中删除描述符
-int Epoll::epoll_del(int fd, __uint32_t events)
+void Epoll::handleDeferred()
 {
-    struct epoll_event event;
-    event.data.fd = fd;
-    event.events = events;
-    if(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event) < 0) //将事件下树
+    std::vector<std::shared_ptr<requestData>> reqs;
+    reqs.swap(deferred_reqs); // 处理中可能再次让出，先换出来
+    for (auto &req : reqs)
     {
-        perror("epoll_del error");
-        return -1;
+        int fd = req->getFd();
+        if (conns[fd].req != req) // 让出期间连接已经关闭
+            continue;
+        req->seperateTimer();
+        req->handleRequest();
     }
-    auto fd_ite = fd2req.find(fd);
-    if (fd_ite != fd2req.end()) //在请求事件对象umap里找到了该文件描述符，删掉其对象
-        fd2req.erase(fd_ite);
-    return 0;
 }
 
 // 封装了下epoll_wait()，返回活跃事件数，多了打印异常
 // 调用代码 int events_num = my_epoll_wait(epoll_fd, MAXEVENTS, -1);
 void Epoll::my_epoll_wait(int listen_fd, int max_events, int timeout)
 {
-    // printf("fd2req.size()==%d\n", fd2req.size());
-    int event_count = epoll_wait(epoll_fd, events, max_events, timeout);
-    if (event_count < 0)
-        perror("epoll wait error");
-    std::vector<std::shared_ptr<requestData>> req_data = getEventsRequest(listen_fd, event_count, PATH); //获取本轮活跃事件数组
-    if (req_data.size() > 0)
+    int event_count = poller->poll(timeout);
+    now_ms = monotonicMs(); // 本轮只读一次时钟
+    getEventsRequest(listen_fd, event_count, PATH); //获取本轮活跃事件数组
+    if (ready_reqs.size() > 0)
     {
-        for (auto &req: req_data) // 遍历活跃事件
+        for (auto &req: ready_reqs) // 遍历活跃事件
         {
             if (ThreadPool::threadpool_add(req) < 0) // 加入到线程池的任务队列中
             {
@@ -97,14 +160,15 @@ void Epoll::my_epoll_wait(int listen_fd, int max_events, int timeout)
                 break;
             }
         }
+        ready_reqs.clear();
     }
 }
 #include <iostream>
 #include <arpa/inet.h>
 using namespace std;
 
-// 监听事件回调函数，即有新的连接，要accept返回新的cfd并绑定上树，还添加了定时器，path记录连接要访问的路径
-void Epoll::acceptConnection(int listen_fd, int epoll_fd, const std::string path)
+// 监听事件回调函数，即有新的连接，要accept返回新的cfd并分发出去
+void Epoll::acceptConnection(int listen_fd, const std::string path)
 {
     struct sockaddr_in client_addr;
     memset(&client_addr, 0, sizeof(struct sockaddr_in));
@@ -116,46 +180,80 @@ void Epoll::acceptConnection(int listen_fd, int epoll_fd, const std::string path
         // cout << client_addr.sin_port << endl;
         // 新连接请求日志
         LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "New connection from IP:"<<client_addr.sin_addr.s_addr<<" PORT:"<<client_addr.sin_port;
-        
-        // 将cfd设为非阻塞模式
-        int ret = setSocketNonBlocking(accept_fd);
-        if (ret < 0)
-        {
-            perror("Set non block failed!");
-            return;
-        }
-        // 把cfd绑定成一个事件对象，用智能指针接收
-        std::shared_ptr<requestData> req_info(new requestData(epoll_fd, accept_fd, path));
-
-        /* 文件描述符可以读，边缘触发(Edge Triggered)模式，还加上了EPOLLONESHOT，每个事件触发一次后内核就会
-        将该文件描述符从就绪队列中移除，保证一个socketfd在任一时刻只被一个线程处理，如果在处理完时还要继续
-        监控该事件，则要重置或者删除重新上树*/
-        __uint32_t _epo_event = EPOLLIN | EPOLLET | EPOLLONESHOT;
-        Epoll::epoll_add(accept_fd, req_info, _epo_event);
-        // 给新的连接的请求对象添加一个定时器，
-        std::shared_ptr<mytimer> mtimer(new mytimer(req_info, TIMER_TIME_OUT));
-        req_info->addTimer(mtimer);
-        MutexLockGuard lock; //上锁，要把定时器放进优先级队列里
-        myTimerQueue.push(mtimer);
+
+        dispatchConnection(accept_fd);
     }
     //if(accept_fd == -1)
      //   perror("accept");
 }
 
+// 多reactor模式下轮流投递给子reactor，否则直接在本循环上树
+void Epoll::dispatchConnection(int accept_fd)
+{
+    // 将cfd设为非阻塞模式；由轮询器收发时连接不会自己read/write，保持阻塞即可
+    if (!ownsIO() && setSocketNonBlocking(accept_fd) < 0)
+    {
+        perror("Set non block failed!");
+        close(accept_fd);
+        return;
+    }
+    if (!sub_loops.empty())
+    {
+        // round-robin选一个子reactor，连接此后的全部事件都在那个线程里处理
+        sub_loops[next_loop]->queueConnection(accept_fd);
+        next_loop = (next_loop + 1) % sub_loops.size();
+    }
+    else
+        newConnection(accept_fd);
+}
+
+// 把cfd绑定成一个事件对象上树，并添加定时器
+void Epoll::newConnection(int accept_fd)
+{
+    // 把cfd绑定成一个事件对象，用智能指针接收
+    std::shared_ptr<requestData> req_info(new requestData(this, accept_fd, PATH));
+
+    /* 文件描述符可以读，边缘触发(Edge Triggered)模式。默认模式下还加上了EPOLLONESHOT，每个事件触发一次后内核就会
+    将该文件描述符从就绪队列中移除，保证一个socketfd在任一时刻只被一个线程处理，如果在处理完时还要继续
+    监控该事件，则要重置或者删除重新上树；子reactor中连接只属于一个线程，不需要ONESHOT */
+    if (epoll_add(accept_fd, req_info, connEvents()) < 0)
+        return;
+    // 给新的连接的请求对象挂上定时器
+    req_info->addTimer(TIMER_TIME_OUT);
+}
+
 // 分发处理函数，遍历活跃事件，装进请求对象加入任务池
-std::vector<std::shared_ptr<requestData>> Epoll::getEventsRequest(int listen_fd, int events_num, const std::string path)
+void Epoll::getEventsRequest(int listen_fd, int events_num, const std::string path)
 {
-    std::vector<std::shared_ptr<requestData>> req_data; // 存储本轮发生事件的请求数据对象
     for(int i = 0; i < events_num; ++i)
     {
-        // 遍历动态数组events获取活跃事件的fd
-        int fd = events[i].data.fd;
+        // 遍历轮询器的活跃事件，从token里解出活跃事件的fd和上树时的gen
+        const PollEvent &ev = poller->event(i);
+        int fd = (int)(uint32_t)ev.token;
+        uint32_t gen = (uint32_t)(ev.token >> 32);
 
         // 活跃事件的描述符为监听描述符
         if(fd == listen_fd)
         {
             //cout << "This is listen_fd" << endl;
-            acceptConnection(listen_fd, epoll_fd, path);
+            if (ev.accept_fd >= 0) // io_uring多发accept已经带回了新连接
+            {
+                LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "New connection fd:"<<ev.accept_fd;
+                dispatchConnection(ev.accept_fd);
+            }
+            else
+                acceptConnection(listen_fd, path);
+        }
+        else if (fd == wakeup_fd) // 主reactor投递了新连接
+        {
+            handleWakeup();
+        }
+        else if (fd == timer_fd) // 有定时器到期了，本轮事件处理完再统一处理
+        {
+            uint64_t cnt;
+            if (read(timer_fd, &cnt, sizeof(cnt)) != sizeof(cnt) && errno != EAGAIN)
+                perror("timerfd read error");
+            timer_fired = true;
         }
         else if (fd < 3) //fd应该至少从3开始，012是标准xx文件
         {
@@ -163,27 +261,184 @@ std::vector<std::shared_ptr<requestData>> Epoll::getEventsRequest(int listen_fd,
         }
         else
         {
+            ConnSlot &slot = conns[fd];
+            if (slot.gen != gen || !slot.req) // 旧连接残留的事件，fd已被关闭或复用
+            {
+                poller->release(ev);
+                continue;
+            }
             // 先排除错误事件
-            if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP)
-                || (!(events[i].events & EPOLLIN)))
+            if ((ev.events & EPOLLERR) || (ev.events & EPOLLHUP)
+                || (!(ev.events & (EPOLLIN | EPOLLOUT))))
             {
                 //printf("error event\n");
-                auto fd_ite = fd2req.find(fd);
-                if (fd_ite != fd2req.end()) // 如果错误事件的fd被记录了，删去
-                    fd2req.erase(fd_ite);
+                // 如果错误事件的fd被记录了，删去
+                ++slot.gen;
+                slot.req.reset();
                 //printf("fd = %d, here\n", fd);
+                poller->release(ev);
                 continue;
             }
 
-            // 到这是说明是读数据请求，将请求任务加入到线程池中
-            std::shared_ptr<requestData> cur_req(fd2req[fd]); // 创建一个智能指针cur_req临时接收下该活跃事件
-            //printf("cur_req.use_count=%d\n", cur_req.use_count());
-            cur_req->seperateTimer();// 加入线程池tp之前将Timer和request分离，因为任务成功被接管了，不用定时器了
-            req_data.push_back(cur_req); //放进本轮活跃事件数组里
-            auto fd_ite = fd2req.find(fd); //把fd2req中的清除
-            if (fd_ite != fd2req.end())
-                fd2req.erase(fd_ite);
+            // 到这是说明是读数据请求，或是没发完的响应可以接着发了
+            slot.req->seperateTimer();// 处理之前将Timer和request分离，因为任务成功被接管了，不用定时器了
+            if (in_loop) // 子reactor直接在本线程处理，连接始终只由这一个线程访问
+            {
+                std::shared_ptr<requestData> cur_req(slot.req); // 处理中可能下树释放槽位，先持有一份
+                cur_req->feedInput(ev.data, ev.len); // io_uring已经收到的数据
+                cur_req->handleRequest();
+            }
+            else
+                ready_reqs.push_back(slot.req); //放进本轮活跃事件数组里，稍后加入线程池
+            poller->release(ev);
+        }
+    }
+}
+
+/* 挂上或刷新定时器，默认模式下会被工作线程调用，要加锁。
+   本循环线程里用本轮缓存的时钟；工作线程和主reactor不在本轮里，时钟可能已经过时，自己读一次。
+   比timerfd布置的时刻还早到期才改timerfd，大部分刷新都只改链表 */
+void Epoll::addTimer(TimerNode *node, int timeout)
+{
+    uint64_t now = in_loop ? now_ms : monotonicMs();
+    MutexLockGuard lock(timer_lock);
+    timers.add(node, now + timeout, now);
+    if (node->expire < timer_armed)
+        armTimer(node->expire, now);
+}
+
+// 布置成过去的时刻timerfd会马上响，一来一回什么也没处理，所以最早布置到now之后1毫秒
+void Epoll::armTimer(uint64_t when, uint64_t now)
+{
+    if (when <= now)
+        when = now + 1;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = when / 1000;
+    its.it_value.tv_nsec = (when % 1000) * 1000000;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    {
+        perror("timerfd_settime error");
+        return;
+    }
+    timer_armed = when;
+}
+
+void Epoll::delTimer(TimerNode *node)
+{
+    MutexLockGuard lock(timer_lock);
+    timers.remove(node);
+}
+
+/* 时间轮走到现在，把到期的连接下树。挂着定时器的连接都在等事件，不在工作线程里。
+   下树可能放掉连接的最后一个引用，析构时又要摘定时器，所以先在锁里把连接取出来，放掉锁再下树 */
+void Epoll::handle_expired_event()
+{
+    {
+        MutexLockGuard lock(timer_lock);
+        timers.advance(now_ms, expired_timers);
+        for (TimerNode *node : expired_timers)
+        {
+            // 连接正在析构(最后一个引用刚放掉、还没来得及摘定时器)时取不到，不用管它
+            std::shared_ptr<requestData> req = static_cast<requestData*>(node->owner)->weak_from_this().lock();
+            if (req)
+                expired_reqs.push_back(req);
         }
+        expired_timers.clear();
+        // timerfd已经响过了，按时间轮剩下的重新布置；布置得比下一次早的照样响，醒来什么都没到期就再布置一次
+        if (timer_armed <= now_ms)
+            timer_armed = TIMER_NEVER;
+        uint64_t next = timers.nextExpire();
+        if (next < timer_armed)
+            armTimer(next, now_ms);
+    }
+    for (auto &req : expired_reqs)
+    {
+        int fd = req->getFd();
+        if (conns[fd].req == req) // 已经因出错事件释放了槽位的不再下树
+            epoll_del(fd, EPOLLIN | EPOLLET | EPOLLONESHOT);
     }
-    return req_data;
-}
\ No newline at end of file
+    expired_reqs.clear();
+}
+
+__uint32_t Epoll::connEvents() const
+{
+    if (in_loop)
+        return EPOLLIN | EPOLLET;
+    return EPOLLIN | EPOLLET | EPOLLONESHOT;
+}
+
+// 等待可写期间不关心可读，新请求留在socket里，发完再换回connEvents()
+__uint32_t Epoll::sendEvents() const
+{
+    return (connEvents() & ~EPOLLIN) | EPOLLOUT;
+}
+
+// 主reactor创建loop_num个子reactor，每个都有自己的epoll句柄、连接表和定时器时间轮，并各自起一个线程运行事件循环
+int Epoll::start_sub_loops(int loop_num, int maxevents, int listen_num)
+{
+    for (int i = 0; i < loop_num; ++i)
+    {
+        std::shared_ptr<Epoll> sub(new Epoll());
+        if (sub->epoll_init(maxevents, listen_num, backend) < 0)
+            return -1;
+        sub->in_loop = true;
+        sub->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (sub->wakeup_fd < 0)
+            return -1;
+        if (sub->poller->add(sub->wakeup_fd, makeToken(sub->wakeup_fd, 0), EPOLLIN) < 0)
+            return -1;
+        if (pthread_create(&sub->thread, NULL, loop_thread, sub.get()) != 0)
+            return -1;
+        sub_loops.push_back(sub);
+    }
+    return 0;
+}
+
+// 由主线程调用，放入待处理队列后用eventfd唤醒子reactor
+void Epoll::queueConnection(int accept_fd)
+{
+    {
+        MutexLockGuard lock(pending_lock);
+        pending_fds.push_back(accept_fd);
+    }
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one))
+        perror("wakeup write error");
+}
+
+void Epoll::handleWakeup()
+{
+    uint64_t cnt;
+    if (read(wakeup_fd, &cnt, sizeof(cnt)) != sizeof(cnt) && errno != EAGAIN)
+        perror("wakeup read error");
+    std::vector<int> fds;
+    {
+        MutexLockGuard lock(pending_lock);
+        fds.swap(pending_fds);
+    }
+    for (int fd : fds)
+        newConnection(fd);
+}
+
+void Epoll::loop(int listen_fd, int timeout)
+{
+    while (true)
+    {
+        // 有让出的连接时不阻塞，收割一下新事件就回来接着处理
+        my_epoll_wait(listen_fd, max_events, deferred_reqs.empty() ? timeout : 0); // 封装了epoll_wait，多了打印异常信息
+        handleDeferred();
+        if (timer_fired) // timerfd响了才处理超时，没有到期的定时器时不碰时间轮的锁
+        {
+            timer_fired = false;
+            handle_expired_event();
+        }
+    }
+}
+
+void *Epoll::loop_thread(void *args)
+{
+    Epoll *sub = static_cast<Epoll*>(args);
+    sub->loop(-1, -1);
+    return NULL;
+}
@@ -1,27 +1,102 @@
 #pragma once
 
 #include "requestData.h"
+#include "poller.h"
+#include "timerWheel.h"
+#include "fdTable.h"
 #include <vector>
-#include <unordered_map>
+#include <deque>
 #include <sys/epoll.h>
+#include <pthread.h>
 #include <memory>
+#include <stdint.h>
 
-// 定义一个Epoll类，封装epoll相关函数
+// 连接表槽位，下标就是fd。gen在每次上树/下树时加一，和fd一起编码进epoll_event.data，
+// 用来识别fd被关闭又复用后还残留在本轮事件里的旧事件
+struct ConnSlot
+{
+    std::shared_ptr<requestData> req;
+    uint32_t gen;
+    ConnSlot(): gen(0) {}
+};
+
+/* 定义一个Epoll类，封装事件循环相关函数。每个Epoll实例就是一个事件循环(reactor)，拥有自己的轮询器(Poller)、
+   连接表和定时器时间轮，轮询器可以是epoll或io_uring后端。
+   默认模式下只有主线程一个实例，可读事件交给线程池处理；
+   多reactor模式下主线程的实例只负责accept，把新连接轮流分给各子reactor，连接此后一直留在该子reactor的线程里处理 */
 class Epoll
 {
 private:
-    static epoll_event *events;
-    static std::unordered_map<int, std::shared_ptr<requestData>> fd2req;
-    /* fd2req是一个哈希映射，将文件描述符映射到对应的requestData对象的智能指针。
-       这样可以在epoll事件发生时快速找到对应的请求数据对象 */
-    static int epoll_fd;
+    Poller *poller;
+    std::string backend;    // 轮询器后端名，子reactor沿用主reactor的
+    FdTable<ConnSlot> conns;
+    /* conns是按fd下标直接寻址的连接表，容量是进程fd上限，槽位按块在fd上树时才分配，
+       事件到来时由token解出fd和gen直接定位，不需要哈希也不需要分配；
+       每个fd的槽位只在上树/下树时写，不同线程不会同时改同一个槽位 */
+    std::vector<std::shared_ptr<requestData>> ready_reqs; // 本轮活跃的请求，循环复用
+    std::vector<std::shared_ptr<requestData>> deferred_reqs; // 流水线请求没处理完、让出了本轮的连接，只在本线程访问
+    int max_events;
+    bool in_loop;   // true表示子reactor，请求在本线程内直接处理，不再经过线程池和EPOLLONESHOT
+
+    // 本循环的定时器时间轮，结点嵌在各个连接里；默认模式下工作线程也会往里放定时器，故仍要加锁
+    TimerWheel timers;
+    pthread_mutex_t timer_lock;
+    /* 定时器到期靠timerfd唤醒：和连接一起在轮询器里监听，布置在时间轮下一次要醒来的时刻，
+       没有定时器时不布置，空闲的服务器不会被叫醒，也不用等网络事件才检查超时 */
+    int timer_fd;
+    uint64_t timer_armed;   // timerfd布置的到期时刻，TIMER_NEVER表示没布置，只在timer_lock里读写
+    bool timer_fired;       // 本轮timerfd响了
+    uint64_t now_ms;        // 本轮轮询返回时读一次的单调时钟，本循环线程里挂定时器、处理超时都用它
+    std::vector<TimerNode*> expired_timers;                 // 本轮到期的结点，循环复用
+    std::vector<std::shared_ptr<requestData>> expired_reqs; // 本轮超时的连接，放掉锁再下树
+
+    // 主reactor轮询分发新连接用
+    std::vector<std::shared_ptr<Epoll>> sub_loops;
+    size_t next_loop;
+
+    // 子reactor接收主reactor投递的新连接：主线程把fd放进pending_fds，再写wakeup_fd(eventfd)唤醒本循环
+    int wakeup_fd;
+    std::vector<int> pending_fds;
+    pthread_mutex_t pending_lock;
+    pthread_t thread;
+
     static const std::string PATH;
+
+private:
+    static uint64_t makeToken(int fd, uint32_t gen) { return ((uint64_t)gen << 32) | (uint32_t)fd; }
+    void handleWakeup(); // 取出主reactor投递来的新连接并上树
+    void armTimer(uint64_t when, uint64_t now); // 在timer_lock里调用，timerfd改到when(单调时钟毫秒)响，不早于now之后1毫秒
+    void dispatchConnection(int accept_fd); // 新连接分给子reactor或本循环
+    void newConnection(int accept_fd); // 为cfd创建请求对象、上树并加定时器
+    static void *loop_thread(void *args);
+    void handleDeferred(); // 接着处理上一轮让出的连接
+
 public:
-    static int epoll_init(int maxevents, int listen_num);
-    static int epoll_add(int fd, std::shared_ptr<requestData> request, __uint32_t events);
-    static int epoll_mod(int fd, std::shared_ptr<requestData> request, __uint32_t events);
-    static int epoll_del(int fd, __uint32_t events);
-    static void my_epoll_wait(int listen_fd, int max_events, int timeout);
-    static void acceptConnection(int listen_fd, int epoll_fd, const std::string path);
-    static std::vector<std::shared_ptr<requestData>> getEventsRequest(int listen_fd, int events_num, const std::string path);
-};
\ No newline at end of file
+    Epoll();
+    ~Epoll();
+    int epoll_init(int maxevents, int listen_num, const std::string &_backend = "epoll");
+    int epoll_add_listener(int listen_fd);
+    int epoll_add(int fd, std::shared_ptr<requestData> request, __uint32_t events);
+    int epoll_mod(int fd, __uint32_t events);
+    int epoll_del(int fd, __uint32_t events);
+    void my_epoll_wait(int listen_fd, int max_events, int timeout);
+    void acceptConnection(int listen_fd, const std::string path);
+    void getEventsRequest(int listen_fd, int events_num, const std::string path);
+
+    void addTimer(TimerNode *node, int timeout);    // 结点挂到timeout毫秒后，已经挂着的就改成这个时间
+    void delTimer(TimerNode *node);                 // 结点从时间轮上摘下来
+    void handle_expired_event();                    // 时间轮走到现在，把超时的连接下树，再布置下一次timerfd
+    __uint32_t connEvents() const;                  // 连接fd上树时要监听的事件，随模式不同
+    __uint32_t sendEvents() const;                  // 响应没发完时连接fd改为监听的事件
+    int send_output(int fd, std::deque<OutChunk> &chunks); // 经由轮询器发送响应
+    void close_fd(int fd);                          // 经由轮询器关闭连接
+    int deferRequest(std::shared_ptr<requestData> req); // 连接还有流水线请求没处理，重新调度一次
+    bool ownsIO() const { return poller->ownsIO(); }
+
+    // 多reactor模式
+    int start_sub_loops(int loop_num, int maxevents, int listen_num); // 主reactor创建并启动loop_num个子reactor线程
+    void queueConnection(int accept_fd);            // 由主线程调用，把新连接投递给本子reactor
+    void loop(int listen_fd, int timeout);          // 事件循环主体
+    bool isInLoop() const { return in_loop; }
+    void setInLoop(bool val) { in_loop = val; }     // 单reactor也可以不用线程池，在本线程直接处理连接
+};
@@ -0,0 +1,403 @@
+#include "epollPoller.h"
+#include "util.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+const size_t SENDFILE_MAX = 1 << 30;   // 单次sendfile/splice的最大字节数
+const int SEND_IOV_MAX = 64;           // 一次sendmsg最多合并的内存块数
+const size_t ZEROCOPY_MIN = 64 * 1024; // 有不小于这个大小的内存块时才用MSG_ZEROCOPY，小数据拷贝比处理完成通知更便宜
+
+EpollPoller::EpollPoller():
+    epoll_fd(-1),
+    ep_events(NULL)
+{
+}
+
+EpollPoller::~EpollPoller()
+{
+    for (size_t fd = 0; fd < fd_states.capacity(); ++fd)
+    {
+        FdState *st = findState(fd);
+        if (st && st->pipe_r >= 0)
+        {
+            ::close(st->pipe_r);
+            ::close(st->pipe_w);
+        }
+    }
+    if (epoll_fd >= 0)
+        ::close(epoll_fd);
+    delete[] ep_events;
+}
+
+// 创建epoll句柄（内核事件表）并初始化事件数组
+int EpollPoller::init(int maxevents, int listen_num)
+{
+    epoll_fd = epoll_create(listen_num + 1); // 创建一个epoll树
+    if(epoll_fd == -1)
+        return -1;
+    max_events = maxevents;
+    ep_events = new epoll_event[maxevents];
+    events = new PollEvent[maxevents];
+    fd_states.init(maxOpenFiles());
+    return 0;
+}
+
+EpollPoller::FdState &EpollPoller::fdState(int fd)
+{
+    std::unique_ptr<FdState> &st = fd_states.at(fd);
+    if (!st)
+        st.reset(new FdState());
+    return *st;
+}
+
+// 布置的事件和token总是记下来，等到第一次用零拷贝时才建状态的话，通知消耗掉EPOLLONESHOT后就不知道该怎么重新布置了
+int EpollPoller::add(int fd, uint64_t token, __uint32_t events)
+{
+    if (fd >= 0 && (size_t)fd < fd_states.capacity())
+    {
+        FdState &st = fdState(fd);
+        st.events = events;
+        st.token = token;
+    }
+    struct epoll_event event;
+    event.data.u64 = token;
+    event.events = events;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        perror("epoll_add error");
+        return -1;
+    }
+    return 0;
+}
+
+int EpollPoller::addListener(int fd, uint64_t token)
+{
+    return add(fd, token, EPOLLIN | EPOLLET);
+}
+
+int EpollPoller::mod(int fd, uint64_t token, __uint32_t events)
+{
+    if (fd >= 0 && (size_t)fd < fd_states.capacity())
+    {
+        FdState &st = fdState(fd);
+        st.events = events;
+        st.token = token;
+    }
+    struct epoll_event event;
+    event.data.u64 = token;
+    event.events = events;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+    {
+        perror("epoll_mod error");
+        return -1;
+    }
+    return 0;
+}
+
+int EpollPoller::del(int fd, uint64_t token)
+{
+    struct epoll_event event;
+    event.data.u64 = token;
+    event.events = 0;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event) < 0) //将事件下树
+    {
+        perror("epoll_del error");
+        return -1;
+    }
+    return 0;
+}
+
+int EpollPoller::poll(int timeout)
+{
+    int event_count = epoll_wait(epoll_fd, ep_events, max_events, timeout);
+    if (event_count < 0)
+    {
+        if (errno != EINTR)
+            perror("epoll wait error");
+        return 0;
+    }
+    int n = 0;
+    for (int i = 0; i < event_count; ++i)
+    {
+        PollEvent &ev = events[n];
+        ev.token = ep_events[i].data.u64;
+        ev.events = ep_events[i].events;
+        ev.accept_fd = -1;
+        ev.data = NULL;
+        ev.len = 0;
+        ev.buf_id = -1;
+        // 零拷贝完成通知走的是错误队列，会以EPOLLERR的形式报上来，不能当成连接出错
+        int fd = (int)(uint32_t)ev.token;
+        FdState *st = findState(fd);
+        if (st && (st->closing || ((ev.events & EPOLLERR) && !st->zc_pending.empty())) && !filterEvent(fd, *st, ev))
+            continue;
+        ++n;
+    }
+    return n;
+}
+
+// 收割错误队列里的零拷贝完成通知，释放内核已经用完的数据
+void EpollPoller::reapZerocopy(int fd, FdState &st)
+{
+    while (!st.zc_pending.empty())
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) // 错误队列空了，MSG_ERRQUEUE不会阻塞
+            return;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            struct sock_extended_err *serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // 一条通知覆盖[ee_info, ee_data]区间内的所有序号，序号是32位循环的
+            uint32_t lo = serr->ee_info;
+            uint32_t span = serr->ee_data - lo;
+            for (auto it = st.zc_pending.begin(); it != st.zc_pending.end(); )
+            {
+                if (it->first - lo <= span)
+                    it = st.zc_pending.erase(it);
+                else
+                    ++it;
+            }
+        }
+    }
+}
+
+/* 处理带零拷贝状态的fd上的事件，返回是否要交给事件循环。
+   已关闭的连接：通知收齐了才真正close；还在用的连接：去掉通知带来的EPOLLERR，
+   只剩这个通知的话EPOLLONESHOT已经被它消耗掉了，按原来的事件重新布置；
+   没有EPOLLONESHOT的(子reactor)一直布置着，不用动 */
+bool EpollPoller::filterEvent(int fd, FdState &st, PollEvent &ev)
+{
+    reapZerocopy(fd, st);
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len); // 顺便清掉挂起的错误，ET模式下不会反复报
+    if (st.closing)
+    {
+        if (st.zc_pending.empty())
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            st.closing = false;
+            st.zerocopy = 0;
+            st.zc_next = 0;
+            ::close(fd);
+        }
+        return false;
+    }
+    if (err != 0)
+        return true;
+    ev.events &= ~EPOLLERR;
+    if (ev.events & (EPOLLIN | EPOLLOUT | EPOLLHUP))
+        return true;
+    if (!(st.events & EPOLLONESHOT))
+        return false;
+    struct epoll_event event;
+    event.data.u64 = st.token;
+    event.events = st.events;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    return false;
+}
+
+// sendfile从文件当前偏移发到socket写满为止，file_off/len随之推进。返回0表示发完或socket写满，-1出错
+int EpollPoller::sendFile(int fd, OutChunk &chunk)
+{
+    while (chunk.len > 0)
+    {
+        ssize_t n = sendfile(fd, chunk.file_fd, &chunk.file_off, chunk.len < SENDFILE_MAX ? chunk.len : SENDFILE_MAX);
+        if (n > 0)
+            chunk.len -= n;
+        else if (n == 0) // 文件在发送过程中被截短了，已经发出的Content-length兑现不了
+            return -1;
+        else if (errno == EAGAIN)
+            return 0;
+        else if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+// 文件 -> 管道 -> socket，两次splice都只移动页引用不拷贝数据；管道里写不进socket的部分记在pending里
+int EpollPoller::spliceFile(int fd, OutChunk &chunk)
+{
+    FdState &p = fdState(fd);
+    if (p.pipe_r < 0)
+    {
+        int pfd[2];
+        if (pipe2(pfd, O_NONBLOCK | O_CLOEXEC) < 0)
+            return -1;
+        p.pipe_r = pfd[0];
+        p.pipe_w = pfd[1];
+    }
+    while (chunk.len > 0 || p.pipe_pending > 0)
+    {
+        if (p.pipe_pending == 0)
+        {
+            ssize_t n = splice(chunk.file_fd, &chunk.file_off, p.pipe_w, NULL,
+                               chunk.len < SENDFILE_MAX ? chunk.len : SENDFILE_MAX, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0)
+            {
+                chunk.len -= n;
+                p.pipe_pending = n;
+            }
+            else if (n == 0)
+                return -1;
+            else if (errno != EINTR) // 管道是空的，普通文件也不会EAGAIN
+                return -1;
+            continue;
+        }
+        ssize_t n = splice(p.pipe_r, NULL, fd, NULL, p.pipe_pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+            p.pipe_pending -= n;
+        else if (n < 0 && errno == EAGAIN)
+            return 0;
+        else if (n == 0 || errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+/* 把队首连续的内存块合并成一次sendmsg(状态行、头部、正文通常一次系统调用、一个包发出)。
+   后面紧跟文件块时带MSG_MORE，让头部和sendfile的数据合在一起发；有大块时用MSG_ZEROCOPY，
+   这次发送涉及的块的owner挂在通知序号上，等内核的完成通知再释放。返回0表示这批发完，1表示socket写满，-1出错 */
+int EpollPoller::sendBuffers(int fd, std::deque<OutChunk> &chunks)
+{
+    struct iovec iov[SEND_IOV_MAX];
+    int iov_num = 0;
+    size_t total = 0;
+    bool large = false;
+    for (auto it = chunks.begin(); it != chunks.end() && it->data && iov_num < SEND_IOV_MAX; ++it)
+    {
+        iov[iov_num].iov_base = const_cast<char*>(it->data);
+        iov[iov_num].iov_len = it->len;
+        total += it->len;
+        large = large || it->len >= ZEROCOPY_MIN;
+        ++iov_num;
+    }
+    int flags = MSG_NOSIGNAL;
+    if ((size_t)iov_num < chunks.size() && !chunks[iov_num].data)
+        flags |= MSG_MORE;
+    FdState *st = NULL;
+    if (large)
+    {
+        st = &fdState(fd);
+        if (st->zerocopy == 0)
+        {
+            int one = 1;
+            st->zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 ? 1 : -1;
+        }
+        if (st->zerocopy > 0)
+            flags |= MSG_ZEROCOPY;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_num;
+    ssize_t n;
+    while ((n = sendmsg(fd, &msg, flags)) < 0)
+    {
+        if (errno == EAGAIN)
+            return 1;
+        if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) // 零拷贝占用的optmem超限，这次退回普通拷贝
+            flags &= ~MSG_ZEROCOPY;
+        else if (errno != EINTR)
+            return -1;
+    }
+    if (flags & MSG_ZEROCOPY) // 每次成功的零拷贝发送占用一个通知序号
+    {
+        for (int i = 0; i < iov_num; ++i)
+            st->zc_pending.push_back(std::make_pair(st->zc_next, chunks[i].owner));
+        ++st->zc_next;
+    }
+    // 去掉已发出的部分
+    size_t left = n;
+    while (left > 0)
+    {
+        OutChunk &chunk = chunks.front();
+        if (left < chunk.len)
+        {
+            chunk.data += left;
+            chunk.len -= left;
+            break;
+        }
+        left -= chunk.len;
+        chunks.pop_front();
+    }
+    return (size_t)n < total ? 1 : 0;
+}
+
+// 就绪模型下在调用线程里写到socket写满为止，没写完的部分留在chunks里，由连接等EPOLLOUT后再发
+int EpollPoller::send(int fd, uint64_t token, std::deque<OutChunk> &chunks)
+{
+    if (FdState *st = findState(fd))
+    {
+        if (!st->zc_pending.empty()) // 顺便释放已经发完的零拷贝数据
+            reapZerocopy(fd, *st);
+    }
+    while (!chunks.empty())
+    {
+        OutChunk &chunk = chunks.front();
+        if (!chunk.data) // 文件数据，直接从页缓存发
+        {
+            bool use_splice = file_mode == FILE_SEND_SPLICE;
+            if ((use_splice ? spliceFile(fd, chunk) : sendFile(fd, chunk)) < 0)
+                return -1;
+            if (chunk.len > 0 || (use_splice && fdState(fd).pipe_pending > 0))
+                return 1;
+            chunks.pop_front();
+            continue;
+        }
+        int ret = sendBuffers(fd, chunks);
+        if (ret != 0)
+            return ret;
+    }
+    return 0;
+}
+
+void EpollPoller::close(int fd)
+{
+    FdState *st = findState(fd);
+    if (st)
+    {
+        // 连接断开时管道里还有没发出去的数据，管道不能再给这个fd号的下一个连接用
+        if (st->pipe_pending > 0)
+        {
+            ::close(st->pipe_r);
+            ::close(st->pipe_w);
+            st->pipe_r = st->pipe_w = -1;
+            st->pipe_pending = 0;
+        }
+        if (!st->zc_pending.empty())
+            reapZerocopy(fd, *st);
+        if (!st->zc_pending.empty())
+        {
+            // 内核还在引用零拷贝的数据，fd先不关(fd号也就不会被新连接复用)，边沿触发挂回树上等完成通知
+            struct epoll_event event;
+            event.data.u64 = (uint32_t)fd;
+            event.events = EPOLLET;
+            st->closing = true;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+                return;
+            st->closing = false;
+            st->zc_pending.clear();
+        }
+        st->zerocopy = 0;
+        st->zc_next = 0;
+    }
+    ::close(fd);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "poller.h"
+#include "fdTable.h"
+#include <sys/epoll.h>
+#include <vector>
+#include <deque>
+#include <memory>
+
+// epoll后端，封装epoll_ctl/epoll_wait，就绪通知后由连接自己读写
+class EpollPoller : public Poller
+{
+private:
+    /* 每个fd在发送路径上的状态，上树时创建(记下布置的事件)，按fd下标存放，fd号复用时接着用；
+       同一个fd同时只会被一个线程发送(EPOLLONESHOT或子reactor独占)，不需要加锁 */
+    struct FdState
+    {
+        // splice用的管道，socket写满时管道里可能还留着数据，要跟着连接等下次可写
+        int pipe_r;
+        int pipe_w;
+        size_t pipe_pending;    // 已从文件搬进管道、还没写进socket的字节数
+        // MSG_ZEROCOPY：内核发完之前数据不能释放，按通知序号挂着owner，收到错误队列里的完成通知再放
+        int zerocopy;           // 0未尝试，1已开启SO_ZEROCOPY，-1不支持
+        uint32_t zc_next;       // 下一次零拷贝发送的通知序号，每个socket从0开始
+        std::deque<std::pair<uint32_t, std::shared_ptr<void>>> zc_pending;
+        bool closing;           // 连接已关闭但还有零拷贝没完成，fd暂不close
+        __uint32_t events;      // 最近一次布置的事件，零拷贝通知消耗了EPOLLONESHOT时用来重新布置
+        uint64_t token;
+        FdState(): pipe_r(-1), pipe_w(-1), pipe_pending(0), zerocopy(0), zc_next(0), closing(false), events(0), token(0) {}
+    };
+
+    int epoll_fd;
+    epoll_event *ep_events;
+    FdTable<std::unique_ptr<FdState>> fd_states; // 容量是进程fd上限，按块在fd上树时才分配
+
+    FdState &fdState(int fd);
+    FdState *findState(int fd) const
+    {
+        std::unique_ptr<FdState> *st = fd_states.find(fd);
+        return st ? st->get() : NULL;
+    }
+    int sendFile(int fd, OutChunk &chunk);
+    int spliceFile(int fd, OutChunk &chunk);
+    int sendBuffers(int fd, std::deque<OutChunk> &chunks);
+    void reapZerocopy(int fd, FdState &st);
+    bool filterEvent(int fd, FdState &st, PollEvent &ev);
+
+public:
+    EpollPoller();
+    ~EpollPoller();
+    int init(int maxevents, int listen_num) override;
+    int add(int fd, uint64_t token, __uint32_t events) override;
+    int addListener(int fd, uint64_t token) override;
+    int mod(int fd, uint64_t token, __uint32_t events) override;
+    int del(int fd, uint64_t token) override;
+    int poll(int timeout) override;
+    int send(int fd, uint64_t token, std::deque<OutChunk> &chunks) override;
+    void close(int fd) override;
+};
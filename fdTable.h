@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <stddef.h>
+
+/* 按fd下标直接寻址的表。fd上限可能是几十万上百万，但实际在用的fd通常只有开头一小段，
+   所以按块(FD_TABLE_BLOCK个槽位)在用到时才分配，没用到的块只占一个空指针。
+   块数组在init时按fd上限一次定好大小，之后不再扩容，已分配的块也不会移动或释放：
+   别的线程拿着某个fd的槽位引用时，本线程给另一个块分配内存不会让它失效。
+   约定新块只由上树的线程通过at()分配，其他线程只访问已上树fd所在的、早已分配好的块 */
+const size_t FD_TABLE_BLOCK = 1024;
+
+template <typename T>
+class FdTable
+{
+public:
+    void init(size_t max_fd) { blocks.resize((max_fd + FD_TABLE_BLOCK - 1) / FD_TABLE_BLOCK); }
+    size_t capacity() const { return blocks.size() * FD_TABLE_BLOCK; }
+
+    // 取fd的槽位，所在块还没分配就分配；fd必须小于capacity()
+    T &at(int fd)
+    {
+        std::unique_ptr<T[]> &block = blocks[fd / FD_TABLE_BLOCK];
+        if (!block)
+            block.reset(new T[FD_TABLE_BLOCK]);
+        return block[fd % FD_TABLE_BLOCK];
+    }
+
+    // 只查不分配，越界或块还没分配时返回NULL
+    T *find(int fd) const
+    {
+        if (fd < 0 || (size_t)fd >= capacity() || !blocks[fd / FD_TABLE_BLOCK])
+            return NULL;
+        return &blocks[fd / FD_TABLE_BLOCK][fd % FD_TABLE_BLOCK];
+    }
+
+    // 已上树的fd所在块一定已分配，直接定位
+    T &operator[](int fd) { return blocks[fd / FD_TABLE_BLOCK][fd % FD_TABLE_BLOCK]; }
+
+private:
+    std::vector<std::unique_ptr<T[]>> blocks;
+};
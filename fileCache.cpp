@@ -0,0 +1,475 @@
+#include "fileCache.h"
+#include "util.h"
+#include "log.h"
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <functional>
+
+size_t FileCache::capacity = FILE_CACHE_DEFAULT;
+size_t FileCache::file_max = FILE_CACHE_FILE_MAX;
+size_t FileCache::fd_max = FILE_CACHE_FD_DEFAULT;
+int FileCache::gzip_level = FILE_CACHE_GZIP_LEVEL;
+
+const int STATS_INTERVAL = 60000;   // 监视线程每隔这么多毫秒把有变化的计数写一次日志
+
+// 文件修改、属性变化、删除、改名都要失效；新建目录要跟着监视
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// 校验值和长度是每个响应都要的头部，条目建好时拼一次
+static void prepareFields(CachedFile &file)
+{
+    file.validator_fields = "ETag: " + file.etag + "\r\nLast-Modified: " + file.last_modified + "\r\n";
+    file.length_field = "Content-length: " + std::to_string(file.size) + "\r\n";
+}
+
+// 把in整个压成gzip格式放进out，失败返回-1
+static int gzipCompress(const std::string &in, int level, std::string &out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) // windowBits加16输出gzip头尾
+        return -1;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH); // 输出空间按deflateBound给足，一次压完
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END ? 0 : -1;
+}
+
+CachedFile::~CachedFile()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+FileCache::FileCache():
+    generation(0),
+    hits(0),
+    misses(0),
+    evictions(0),
+    invalidations(0),
+    compressions(0),
+    inotify_fd(-1),
+    watching(false),
+    compressing(false)
+{
+    pthread_mutex_init(&gzip_lock, NULL);
+    pthread_cond_init(&gzip_cond, NULL);
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i)
+    {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].bytes = 0;
+    }
+}
+
+FileCache::~FileCache()
+{
+    // 单例随进程退出析构，监视线程还阻塞在poll里，不等它，也不关inotify_fd；压缩线程还等在gzip_cond上，它的锁不销毁
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i)
+        pthread_mutex_destroy(&shards[i].lock);
+}
+
+FileCache::Shard &FileCache::shardOf(const std::string &path)
+{
+    return shards[std::hash<std::string>()(path) % FILE_CACHE_SHARDS];
+}
+
+int FileCache::start()
+{
+    if (capacity == 0 && fd_max == 0)
+        return 0;
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0)
+    {
+        perror("inotify_init1 failed, file cache disabled");
+        return -1;
+    }
+    addWatch("");
+    watching = true;
+    if (pthread_create(&watcher, NULL, watchThread, this) != 0)
+    {
+        perror("file cache watcher start failed");
+        watching = false;
+        close(inotify_fd);
+        inotify_fd = -1;
+        return -1;
+    }
+    pthread_detach(watcher);
+    if (gzip_level > 0)
+    {
+        compressing = true;
+        if (pthread_create(&compressor, NULL, compressThread, this) != 0)
+        {
+            perror("file cache compressor start failed, serving uncompressed");
+            compressing = false;
+        }
+        else
+            pthread_detach(compressor);
+    }
+    return 0;
+}
+
+void FileCache::addWatch(const std::string &dir)
+{
+    int wd = inotify_add_watch(inotify_fd, dir.empty() ? "." : dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        perror("inotify_add_watch failed");
+        return;
+    }
+    watch_dirs[wd] = dir;
+    DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+    if (d == NULL)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        std::string sub = dir.empty() ? ent->d_name : dir + "/" + ent->d_name;
+        struct stat st;
+        // 有的文件系统不填d_type，要再stat一次
+        if (ent->d_type == DT_DIR || (ent->d_type == DT_UNKNOWN && stat(sub.c_str(), &st) == 0 && S_ISDIR(st.st_mode)))
+            addWatch(sub);
+    }
+    closedir(d);
+}
+
+void *FileCache::watchThread(void *args)
+{
+    FileCache *cache = static_cast<FileCache*>(args);
+    // 按inotify_event对齐，一次读进多个事件
+    char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+    std::string last_stats;
+    while (true)
+    {
+        struct pollfd pfd = {cache->inotify_fd, POLLIN, 0};
+        int ret = poll(&pfd, 1, STATS_INTERVAL);
+        if (ret < 0 && errno != EINTR)
+        {
+            perror("file cache watcher poll failed");
+            break;
+        }
+        if (ret == 0)
+        {
+            std::string stats = cache->stats();
+            if (stats != last_stats)
+            {
+                LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "File cache: "<<stats;
+                last_stats = stats;
+            }
+            continue;
+        }
+        ssize_t len = read(cache->inotify_fd, buf, sizeof(buf));
+        if (len < 0 && errno != EINTR && errno != EAGAIN)
+        {
+            perror("file cache watcher read failed");
+            break;
+        }
+        if (len > 0)
+            cache->handleEvents(buf, len);
+    }
+    // 监视不了就不能再相信缓存里的内容，之后一律不命中
+    cache->watching = false;
+    cache->clear();
+    close(cache->inotify_fd);
+    return NULL;
+}
+
+void *FileCache::compressThread(void *args)
+{
+    FileCache *cache = static_cast<FileCache*>(args);
+    while (true)
+    {
+        pthread_mutex_lock(&cache->gzip_lock);
+        while (cache->gzip_jobs.empty())
+            pthread_cond_wait(&cache->gzip_cond, &cache->gzip_lock);
+        GzipJob job = cache->gzip_jobs.front();
+        cache->gzip_jobs.pop_front();
+        pthread_mutex_unlock(&cache->gzip_lock);
+
+        const CachedFile &src = *job.file;
+        std::shared_ptr<CachedFile> gzip(new CachedFile);
+        // 压不小的(已经压缩过的格式)不挂，gzip_queued留着，不会再交过来
+        if (gzipCompress(src.data, gzip_level, gzip->data) < 0 || gzip->data.size() >= src.size)
+            continue;
+        gzip->kind = CACHED_MEMORY;
+        gzip->size = gzip->data.size();
+        gzip->mtime = src.mtime;
+        gzip->last_modified = src.last_modified;
+        // 压缩版本是另一种表示，强校验值不能和原文件相同
+        gzip->etag = src.etag.substr(0, src.etag.size() - 1) + "-gz\"";
+        prepareFields(*gzip);
+        cache->storeGzip(job, gzip);
+    }
+    return NULL;
+}
+
+void FileCache::storeGzip(const GzipJob &job, std::shared_ptr<const CachedFile> gzip)
+{
+    size_t limit = capacity / FILE_CACHE_SHARDS;
+    if (job.file->size + gzip->size > limit)
+        return;
+    Shard &shard = shardOf(job.path);
+    pthread_mutex_lock(&shard.lock);
+    auto it = shard.index.find(job.path);
+    if (it == shard.index.end() || it->second->file != job.file) // 压缩期间被淘汰或者失效了
+    {
+        pthread_mutex_unlock(&shard.lock);
+        return;
+    }
+    std::atomic_store(&job.file->gzip, gzip);
+    shard.bytes += gzip->size;
+    ++compressions;
+    std::list<Entry> &lru = shard.lru[CACHED_MEMORY];
+    lru.splice(lru.begin(), lru, it->second);
+    while (lru.size() > 1 && shard.bytes > limit)
+    {
+        erase(shard, shard.index.find(lru.back().path));
+        ++evictions;
+    }
+    pthread_mutex_unlock(&shard.lock);
+}
+
+void FileCache::handleEvents(const char *buf, ssize_t len)
+{
+    for (const char *p = buf; p < buf + len; )
+    {
+        const struct inotify_event *ev = reinterpret_cast<const struct inotify_event*>(p);
+        p += sizeof(struct inotify_event) + ev->len;
+        if (ev->mask & IN_Q_OVERFLOW) // 丢了事件，不知道哪些文件变了
+        {
+            clear();
+            continue;
+        }
+        auto it = watch_dirs.find(ev->wd);
+        if (it == watch_dirs.end())
+            continue;
+        if (ev->mask & IN_IGNORED) // 目录被删了，监视自动撤销
+        {
+            watch_dirs.erase(it);
+            continue;
+        }
+        std::string dir = it->second;
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) // 目录本身没了或者换了位置，下面的键全都不对了
+        {
+            clear();
+            continue;
+        }
+        if (ev->len == 0)
+            continue;
+        std::string path = dir.empty() ? ev->name : dir + "/" + ev->name;
+        if (ev->mask & IN_ISDIR)
+        {
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) // 新目录也要监视，搬进来的目录里可能已经有文件了
+                addWatch(path);
+            // 子目录有增减或者权限变了，它下面(包括还没监视上的新目录下面)记着的不存在的文件可能已经有了
+            clear();
+            continue;
+        }
+        invalidate(path);
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::lookup(const std::string &path)
+{
+    /* 只缓存规范的相对路径(canonicalPath)。同一个文件换个写法(./a、a//b)就是另一个键，
+       inotify事件只能对上规范的名字；请求行里不规范的路径已经回了400，这里只是兜底 */
+    bool cacheable = enabled() && canonicalPath(path);
+    if (cacheable)
+    {
+        Shard &shard = shardOf(path);
+        pthread_mutex_lock(&shard.lock);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end())
+        {
+            std::list<Entry> &lru = shard.lru[it->second->file->kind];
+            lru.splice(lru.begin(), lru, it->second);
+            std::shared_ptr<const CachedFile> file = it->second->file;
+            pthread_mutex_unlock(&shard.lock);
+            ++hits;
+            return file;
+        }
+        pthread_mutex_unlock(&shard.lock);
+        ++misses;
+    }
+
+    uint64_t gen = generation;
+    std::shared_ptr<CachedFile> file(new CachedFile);
+    // 直接open再fstat，只查一次路径；O_NONBLOCK免得碰上命名管道卡住，对普通文件的读没有影响
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+    {
+        if (errno != ENOENT && errno != ENOTDIR)
+            return std::shared_ptr<const CachedFile>();
+    }
+    else
+    {
+        file->fd = fd; // 交给条目，之后从哪里返回都随条目关闭
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+            return std::shared_ptr<const CachedFile>();
+        if (S_ISREG(st.st_mode))
+        {
+            file->size = st.st_size;
+            file->mtime = st.st_mtime;
+            file->last_modified = httpDate(st.st_mtime);
+            char etag[64];
+            snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"", (unsigned long long)st.st_ino,
+                     (unsigned long long)st.st_size,
+                     (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+            file->etag = etag;
+            prepareFields(*file);
+            if (file->size <= file_max && file->size <= capacity / FILE_CACHE_SHARDS)
+            {
+                file->data.resize(file->size);
+                if (readn(fd, &file->data[0], file->size) != (ssize_t)file->size) // 读的时候被截短了
+                    return std::shared_ptr<const CachedFile>();
+                close(fd);
+                file->fd = -1;
+                file->kind = CACHED_MEMORY;
+            }
+            else
+                file->kind = CACHED_FD;
+        }
+        else // 目录等不是普通文件的，和不存在一样回404
+        {
+            close(fd);
+            file->fd = -1;
+        }
+    }
+    if (cacheable)
+        insert(path, file, gen);
+    return file;
+}
+
+std::shared_ptr<const CachedFile> FileCache::gzipped(const std::string &path, const std::shared_ptr<const CachedFile> &file)
+{
+    if (file->kind != CACHED_MEMORY || !compressing || !enabled())
+        return std::shared_ptr<const CachedFile>();
+    std::shared_ptr<const CachedFile> gzip = std::atomic_load(&file->gzip);
+    if (gzip || file->size < FILE_CACHE_GZIP_MIN || !canonicalPath(path) || file->gzip_queued.exchange(true))
+        return gzip;
+    pthread_mutex_lock(&gzip_lock);
+    if (gzip_jobs.size() < FILE_CACHE_GZIP_QUEUE)
+    {
+        gzip_jobs.push_back(GzipJob{path, file});
+        pthread_cond_signal(&gzip_cond);
+    }
+    else
+        file->gzip_queued = false; // 压缩线程忙不过来，下次再交
+    pthread_mutex_unlock(&gzip_lock);
+    return gzip;
+}
+
+void FileCache::insert(const std::string &path, const std::shared_ptr<const CachedFile> &file, uint64_t gen)
+{
+    // 各种条目在一个分片里的预算，fd数不够分的每片至少一个
+    size_t limit;
+    if (file->kind == CACHED_MEMORY)
+        limit = capacity / FILE_CACHE_SHARDS;
+    else if (file->kind == CACHED_FD)
+        limit = (fd_max + FILE_CACHE_SHARDS - 1) / FILE_CACHE_SHARDS;
+    else
+        limit = FILE_CACHE_MISSING_MAX / FILE_CACHE_SHARDS;
+    if (limit == 0)
+        return;
+    Shard &shard = shardOf(path);
+    std::list<Entry> &lru = shard.lru[file->kind];
+    pthread_mutex_lock(&shard.lock);
+    if (generation != gen) // 查文件的时候有文件变了，可能就是这个
+    {
+        pthread_mutex_unlock(&shard.lock);
+        return;
+    }
+    auto it = shard.index.find(path);
+    if (it != shard.index.end()) // 别的线程同时也查了这个文件
+        erase(shard, it);
+    lru.push_front(Entry{path, file});
+    shard.index[path] = lru.begin();
+    if (file->kind == CACHED_MEMORY)
+        shard.bytes += file->data.size();
+    // 淘汰同种条目里最久没用的，正在发送的条目由发送队列里的引用保活，fd也等发完才关闭
+    while (lru.size() > 1 && (file->kind == CACHED_MEMORY ? shard.bytes : lru.size()) > limit)
+    {
+        erase(shard, shard.index.find(lru.back().path));
+        ++evictions;
+    }
+    pthread_mutex_unlock(&shard.lock);
+}
+
+void FileCache::erase(Shard &shard, std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it)
+{
+    const CachedFile &file = *it->second->file;
+    if (file.kind == CACHED_MEMORY)
+    {
+        shard.bytes -= file.data.size();
+        std::shared_ptr<const CachedFile> gzip = std::atomic_load(&file.gzip);
+        if (gzip)
+            shard.bytes -= gzip->size;
+    }
+    shard.lru[file.kind].erase(it->second);
+    shard.index.erase(it);
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    Shard &shard = shardOf(path);
+    pthread_mutex_lock(&shard.lock);
+    ++generation; // 在锁里加，lookup看到的要么是加之前(插入后会被这里删掉)要么是加之后(不插入)
+    auto it = shard.index.find(path);
+    if (it != shard.index.end())
+    {
+        erase(shard, it);
+        ++invalidations;
+    }
+    pthread_mutex_unlock(&shard.lock);
+}
+
+void FileCache::clear()
+{
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i)
+    {
+        Shard &shard = shards[i];
+        pthread_mutex_lock(&shard.lock);
+        ++generation;
+        invalidations += shard.index.size();
+        for (int kind = 0; kind < CACHED_KINDS; ++kind)
+            shard.lru[kind].clear();
+        shard.index.clear();
+        shard.bytes = 0;
+        pthread_mutex_unlock(&shard.lock);
+    }
+}
+
+std::string FileCache::stats()
+{
+    size_t entries[CACHED_KINDS] = {0}, bytes = 0;
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        for (int kind = 0; kind < CACHED_KINDS; ++kind)
+            entries[kind] += shards[i].lru[kind].size();
+        bytes += shards[i].bytes;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    char buf[256];
+    snprintf(buf, sizeof(buf), "hits=%llu misses=%llu evictions=%llu invalidations=%llu compressions=%llu"
+             " files=%zu bytes=%zu fds=%zu missing=%zu",
+             (unsigned long long)hits, (unsigned long long)misses, (unsigned long long)evictions,
+             (unsigned long long)invalidations, (unsigned long long)compressions,
+             entries[CACHED_MEMORY], bytes, entries[CACHED_FD], entries[CACHED_MISSING]);
+    return buf;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "singleton.h"
+
+const size_t FILE_CACHE_DEFAULT = 64 << 20;     // 缓存的文件内容加起来最多这么多字节，0表示不缓存
+const size_t FILE_CACHE_FILE_MAX = 1 << 20;     // 单个文件超过这么大不读进内存，只缓存打开的fd，仍按sendfile/splice/mmap发送
+const size_t FILE_CACHE_FD_DEFAULT = 256;       // 缓存着的大文件fd最多这么多个，0表示不缓存fd
+const size_t FILE_CACHE_MISSING_MAX = 4096;     // 不存在的文件(404)最多记这么多个
+const int FILE_CACHE_GZIP_LEVEL = 6;            // 在线压缩的zlib压缩级别，0表示不在线压缩
+const size_t FILE_CACHE_GZIP_MIN = 256;         // 比这还小的文件压缩省不了什么，不压
+const size_t FILE_CACHE_GZIP_QUEUE = 256;       // 等着压缩的文件最多这么多个，再多的这次先不压
+const int FILE_CACHE_SHARDS = 16;               // 分片数，每片一把锁，各片按容量平分预算
+
+// 缓存条目的种类，每种在分片里各有一条LRU链表和自己的预算
+enum CachedKind
+{
+    CACHED_MEMORY = 0,  // 小文件，整个内容在data里
+    CACHED_FD,          // 大文件，留着打开的fd，发送时直接sendfile/splice/mmap它
+    CACHED_MISSING,     // 文件不存在或者不是普通文件，直接回404
+    CACHED_KINDS
+};
+
+/* 缓存里的一个文件。内容、fd和元数据一起只读共享，发送队列持有引用期间即使被淘汰或失效也不会释放，
+   最后一个引用放掉时才关闭fd */
+struct CachedFile
+{
+    CachedKind kind;
+    std::string data;           // CACHED_MEMORY时是整个文件内容
+    int fd;                     // CACHED_FD时是只读打开的文件，否则为-1
+    size_t size;
+    time_t mtime;
+    std::string last_modified;  // 按mtime格式化好的HTTP日期
+    std::string etag;           // 由inode、大小和纳秒级mtime拼成的强校验值，带引号
+    std::string validator_fields;   // 拼好的"ETag: ...\r\nLast-Modified: ...\r\n"，响应头部直接追加
+    std::string length_field;       // 拼好的整个文件的"Content-length: ...\r\n"
+    /* 压缩线程压好的gzip版本(CACHED_MEMORY)，只在分片锁里设置，读写都用std::atomic_load/store；
+       条目失效时随条目一起丢掉，所以压缩版本不会比原文件旧 */
+    mutable std::shared_ptr<const CachedFile> gzip;
+    mutable std::atomic<bool> gzip_queued;      // 已经交给压缩线程了，压完或者压不小都不再交
+
+    CachedFile(): kind(CACHED_MISSING), fd(-1), size(0), mtime(0), gzip_queued(false) {}
+    ~CachedFile();
+    bool exists() const { return kind != CACHED_MISSING; }
+};
+
+/* 静态文件缓存，键是相对网站根目录的文件名。
+   按文件名哈希分成FILE_CACHE_SHARDS片，每片一把锁，小文件、大文件fd、不存在的文件各一条LRU链表，
+   超出本片的字节数、fd数或条目数预算就从对应链表尾淘汰；命中时直接拿到内容或fd和元数据，不再stat、open、mmap，
+   不存在的文件也不用再stat一次。
+   文件变化靠inotify监视根目录(及其子目录)得知：监视线程收到修改、新建、删除、改名等事件就把对应的条目删掉，
+   事件队列溢出或者目录有增减、目录本身变了就整个清空。未命中时查文件期间如果发生过失效，查到的结果不放进缓存。
+   可压缩的小文件第一次被要gzip时交给压缩线程，压好的版本挂在条目上、计入本片字节数，之后的请求直接发压缩版本 */
+class FileCache
+{
+private:
+    struct Entry
+    {
+        std::string path;
+        std::shared_ptr<const CachedFile> file;
+    };
+    struct Shard
+    {
+        pthread_mutex_t lock;
+        std::list<Entry> lru[CACHED_KINDS];     // 每种条目一条，最近用过的在前面
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes;                           // CACHED_MEMORY条目的内容大小之和
+    };
+    Shard shards[FILE_CACHE_SHARDS];
+    std::atomic<uint64_t> generation;   // 每次失效加一
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    std::atomic<uint64_t> invalidations;
+    std::atomic<uint64_t> compressions;
+    int inotify_fd;
+    std::atomic<bool> watching;         // 监视线程在工作，出错退出后缓存一律不命中
+    std::unordered_map<int, std::string> watch_dirs; // inotify监视号对应的目录(相对根目录，根目录为空)，只在监视线程里改
+    pthread_t watcher;
+    struct GzipJob
+    {
+        std::string path;
+        std::shared_ptr<const CachedFile> file;
+    };
+    pthread_mutex_t gzip_lock;
+    pthread_cond_t gzip_cond;
+    std::deque<GzipJob> gzip_jobs;      // 等着压缩的条目
+    bool compressing;                   // 压缩线程在工作，没有就不在线压缩
+    pthread_t compressor;
+
+    Shard &shardOf(const std::string &path);
+    void addWatch(const std::string &dir);      // 监视dir和它下面所有的子目录
+    void insert(const std::string &path, const std::shared_ptr<const CachedFile> &file, uint64_t gen); // 查文件期间没有失效过才放进去
+    void erase(Shard &shard, std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it);
+    void handleEvents(const char *buf, ssize_t len);
+    static void *watchThread(void *args);
+    static void *compressThread(void *args);
+    void storeGzip(const GzipJob &job, std::shared_ptr<const CachedFile> gzip); // 条目还在缓存里才挂上压缩版本
+
+public:
+    static size_t capacity;     // 启动时设置一次，之后只读
+    static size_t file_max;
+    static size_t fd_max;
+    static int gzip_level;
+
+    FileCache();
+    ~FileCache();
+    int start();                // 监视当前工作目录(网站根目录)并启动监视线程，capacity和fd_max都为0时什么都不做
+    bool enabled() const { return watching; }
+    /* 命中返回条目并移到LRU前面；未命中时stat并打开文件，小文件读进内存、大文件留着fd，不存在的记成CACHED_MISSING，
+       能缓存(监视线程在工作、路径规范、没超预算)就放进缓存，不能也照样返回。
+       stat和open遇到不存在以外的错误(比如没有权限)返回NULL，不缓存 */
+    std::shared_ptr<const CachedFile> lookup(const std::string &path);
+    /* 缓存里的小文件file压好的gzip版本，还没有就返回NULL并交给压缩线程(只交一次)，这次先发原文件。
+       file必须是path刚从lookup拿到的CACHED_MEMORY条目，不在缓存里的压了也没处放，不压 */
+    std::shared_ptr<const CachedFile> gzipped(const std::string &path, const std::shared_ptr<const CachedFile> &file);
+    void invalidate(const std::string &path);
+    void clear();
+    std::string stats();        // hits、misses、evictions等计数和各种条目数，给日志用
+};
+
+typedef Singleton<FileCache> FileCacheMgr;
@@ -0,0 +1,393 @@
+#include "hpack.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// 静态表(RFC 7541 附录A)，下标从1开始，这里的第0项是下标1
+static const struct
+{
+    const char *name;
+    const char *value;
+} static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+static const size_t STATIC_COUNT = sizeof(static_table) / sizeof(static_table[0]);
+
+// Huffman码表(RFC 7541 附录B)：每个符号的码字和位数，第256个是EOS
+static const struct
+{
+    uint32_t code;
+    uint8_t bits;
+} huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+};
+
+/* 由码表建成的二叉树，按位从根走到叶子就是一个符号。
+   节点0是根，孩子为0表示没有这条边(根不会是别的节点的孩子) */
+struct HuffmanTree
+{
+    struct Node
+    {
+        uint16_t child[2];
+        int16_t sym;    // 叶子上的符号，内部节点为-1
+    };
+    std::vector<Node> nodes;
+
+    HuffmanTree()
+    {
+        nodes.push_back(Node{{0, 0}, -1});
+        for (int sym = 0; sym < 257; ++sym)
+        {
+            size_t cur = 0;
+            for (int i = huffman_codes[sym].bits - 1; i >= 0; --i)
+            {
+                int bit = (huffman_codes[sym].code >> i) & 1;
+                if (nodes[cur].child[bit] == 0)
+                {
+                    nodes[cur].child[bit] = nodes.size();
+                    nodes.push_back(Node{{0, 0}, -1});
+                }
+                cur = nodes[cur].child[bit];
+            }
+            nodes[cur].sym = sym;
+        }
+    }
+};
+
+static const HuffmanTree &huffmanTree()
+{
+    static const HuffmanTree tree; // 第一次用到时建树，C++11起局部静态变量的初始化是线程安全的
+    return tree;
+}
+
+/* 补齐最后一个字节的填充必须是EOS码字的高位(全1)且不到8位；
+   解出EOS本身也是错误 */
+static int huffmanDecode(const uint8_t *buf, size_t len, std::string &out)
+{
+    const HuffmanTree &tree = huffmanTree();
+    size_t cur = 0;
+    int pad_bits = 0;       // 上一个符号之后走过的位数
+    bool pad_ones = true;   // 这些位是否全是1
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int shift = 7; shift >= 0; --shift)
+        {
+            int bit = (buf[i] >> shift) & 1;
+            cur = tree.nodes[cur].child[bit];
+            if (cur == 0)
+                return HPACK_ERROR;
+            ++pad_bits;
+            pad_ones = pad_ones && bit;
+            int sym = tree.nodes[cur].sym;
+            if (sym >= 0)
+            {
+                if (sym == 256)
+                    return HPACK_ERROR;
+                out += (char)sym;
+                cur = 0;
+                pad_bits = 0;
+                pad_ones = true;
+            }
+        }
+    }
+    if (pad_bits > 7 || !pad_ones)
+        return HPACK_ERROR;
+    return 0;
+}
+
+// 前缀prefix位的整数(RFC 7541 5.1)，p指向它的第一个字节，解完后指向下一个字节
+static int decodeInt(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t &value)
+{
+    uint64_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return 0;
+    for (int shift = 0; p < end; shift += 7)
+    {
+        if (shift > 28) // 头部里不会有这么大的数，防止溢出
+            return HPACK_ERROR;
+        uint8_t b = *p++;
+        value += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return HPACK_ERROR;
+}
+
+// 字符串字面量：最高位表示Huffman编码，接着是7位前缀的长度
+static int decodeString(const uint8_t *&p, const uint8_t *end, std::string &out)
+{
+    if (p >= end)
+        return HPACK_ERROR;
+    bool huffman = *p & 0x80;
+    uint64_t len;
+    if (decodeInt(p, end, 7, len) < 0 || len > (uint64_t)(end - p))
+        return HPACK_ERROR;
+    out.clear();
+    if (huffman)
+    {
+        if (huffmanDecode(p, len, out) < 0)
+            return HPACK_ERROR;
+    }
+    else
+        out.assign(reinterpret_cast<const char*>(p), len);
+    p += len;
+    return 0;
+}
+
+static void encodeInt(uint64_t value, int prefix, uint8_t first, std::string &out)
+{
+    uint64_t max = (1u << prefix) - 1;
+    if (value < max)
+    {
+        out += (char)(first | value);
+        return;
+    }
+    out += (char)(first | max);
+    value -= max;
+    while (value >= 0x80)
+    {
+        out += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static void encodeString(std::string_view s, std::string &out)
+{
+    encodeInt(s.size(), 7, 0, out);
+    out.append(s.data(), s.size());
+}
+
+HpackDecoder::HpackDecoder():
+    dynamic_size(0),
+    max_size(HPACK_TABLE_SIZE_DEFAULT)
+{
+}
+
+bool HpackDecoder::lookup(uint64_t index, std::string *name, std::string *value) const
+{
+    if (index == 0)
+        return false;
+    if (index <= STATIC_COUNT)
+    {
+        *name = static_table[index - 1].name;
+        if (value)
+            *value = static_table[index - 1].value;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= dynamic.size())
+        return false;
+    *name = dynamic[index].name;
+    if (value)
+        *value = dynamic[index].value;
+    return true;
+}
+
+void HpackDecoder::evict(size_t limit)
+{
+    while (dynamic_size > limit && !dynamic.empty())
+    {
+        dynamic_size -= dynamic.back().name.size() + dynamic.back().value.size() + HPACK_ENTRY_OVERHEAD;
+        dynamic.pop_back();
+    }
+}
+
+void HpackDecoder::insert(const HpackHeader &header)
+{
+    size_t size = header.name.size() + header.value.size() + HPACK_ENTRY_OVERHEAD;
+    if (size > max_size) // 比整个表还大的条目会清空表，自己也放不进去
+    {
+        evict(0);
+        return;
+    }
+    evict(max_size - size);
+    dynamic.push_front(header);
+    dynamic_size += size;
+}
+
+int HpackDecoder::decode(const uint8_t *buf, size_t len, size_t max_list_size, std::vector<HpackHeader> &headers)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+    size_t list_size = 0;
+    while (p < end)
+    {
+        uint8_t b = *p;
+        uint64_t index;
+        HpackHeader header;
+        if (b & 0x80) // 1xxxxxxx 表里已有的头部
+        {
+            if (decodeInt(p, end, 7, index) < 0)
+                return HPACK_ERROR;
+            if (!lookup(index, &header.name, &header.value))
+                return HPACK_ERROR;
+        }
+        else if ((b & 0xe0) == 0x20) // 001xxxxx 动态表大小调整
+        {
+            if (decodeInt(p, end, 5, index) < 0 || index > HPACK_TABLE_SIZE_DEFAULT)
+                return HPACK_ERROR;
+            max_size = index;
+            evict(max_size);
+            continue;
+        }
+        else // 01xxxxxx 字面量并加入动态表，0000xxxx/0001xxxx 字面量不加索引
+        {
+            bool indexing = b & 0x40;
+            if (decodeInt(p, end, indexing ? 6 : 4, index) < 0)
+                return HPACK_ERROR;
+            if (index > 0)
+            {
+                if (!lookup(index, &header.name, NULL))
+                    return HPACK_ERROR;
+            }
+            else if (decodeString(p, end, header.name) < 0)
+                return HPACK_ERROR;
+            if (decodeString(p, end, header.value) < 0)
+                return HPACK_ERROR;
+            if (indexing)
+                insert(header);
+        }
+        list_size += header.name.size() + header.value.size() + HPACK_ENTRY_OVERHEAD;
+        if (list_size > max_list_size)
+            return HPACK_ERROR;
+        headers.push_back(std::move(header));
+    }
+    return 0;
+}
+
+// 常见状态码在静态表里有完整的条目(下标8到14)，其他的用:status的名字加字面量值
+void hpackEncodeStatus(int status, std::string &out)
+{
+    for (size_t i = 7; i < 14; ++i)
+    {
+        if (atoi(static_table[i].value) == status)
+        {
+            encodeInt(i + 1, 7, 0x80, out);
+            return;
+        }
+    }
+    char value[8];
+    snprintf(value, sizeof(value), "%03d", status);
+    encodeInt(8, 4, 0x00, out);
+    encodeString(value, out);
+}
+
+void hpackEncodeHeader(std::string_view name, std::string_view value, std::string &out)
+{
+    // 名字在静态表里就只写下标
+    for (size_t i = 0; i < STATIC_COUNT; ++i)
+    {
+        if (name == static_table[i].name)
+        {
+            encodeInt(i + 1, 4, 0x00, out);
+            encodeString(value, out);
+            return;
+        }
+    }
+    out += (char)0x00;
+    encodeString(name, out);
+    encodeString(value, out);
+}
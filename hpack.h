@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+const size_t HPACK_TABLE_SIZE_DEFAULT = 4096;  // SETTINGS_HEADER_TABLE_SIZE的默认值，服务器不改它
+const size_t HPACK_ENTRY_OVERHEAD = 32;        // 动态表里每个条目除了名字和值额外算的字节数
+const int HPACK_ERROR = -1;                    // 头部块格式错误，按COMPRESSION_ERROR关闭连接
+
+// 解码出的一个头部，HTTP/2的头部名字都是小写的
+struct HpackHeader
+{
+    std::string name;
+    std::string value;
+};
+
+/* HTTP/2一个连接上客户端到服务器方向的HPACK解码器(RFC 7541)。
+   动态表跨请求保存，所以同一个连接上的头部块必须按到达的顺序全部解码，出错的请求也不能跳过；
+   新条目加在deque前面，超过表的大小从后面淘汰。Huffman编码的字符串按码表建好的二叉树逐位解 */
+class HpackDecoder
+{
+private:
+    std::deque<HpackHeader> dynamic;
+    size_t dynamic_size;    // 动态表按RFC算出的大小
+    size_t max_size;        // 编码方用Dynamic Table Size Update设的上限，不能超过HPACK_TABLE_SIZE_DEFAULT
+
+    // 静态表接动态表的下标，value为NULL时只取名字，下标不存在返回false
+    bool lookup(uint64_t index, std::string *name, std::string *value) const;
+    void insert(const HpackHeader &header);
+    void evict(size_t limit);                        // 淘汰最老的条目直到大小不超过limit
+
+public:
+    HpackDecoder();
+    // 解码一个完整的头部块追加到headers，名字和值加起来超过max_list_size也按错误处理，出错返回HPACK_ERROR
+    int decode(const uint8_t *buf, size_t len, size_t max_list_size, std::vector<HpackHeader> &headers);
+};
+
+/* 服务器到客户端方向只用静态表和不加索引的字面量，不维护动态表，也不用Huffman编码：
+   响应头部不多，这样编码器没有状态，各个流的HEADERS帧按什么顺序发出都不会让两端的表不一致 */
+void hpackEncodeStatus(int status, std::string &out);
+void hpackEncodeHeader(std::string_view name, std::string_view value, std::string &out); // name必须是小写
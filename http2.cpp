@@ -0,0 +1,639 @@
+#include "http2.h"
+#include "requestData.h"
+#include <string.h>
+#include <algorithm>
+
+const char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// 帧类型(RFC 9113 6)
+enum
+{
+    FRAME_DATA = 0,
+    FRAME_HEADERS = 1,
+    FRAME_PRIORITY = 2,
+    FRAME_RST_STREAM = 3,
+    FRAME_SETTINGS = 4,
+    FRAME_PUSH_PROMISE = 5,
+    FRAME_PING = 6,
+    FRAME_GOAWAY = 7,
+    FRAME_WINDOW_UPDATE = 8,
+    FRAME_CONTINUATION = 9
+};
+
+// 帧标志，ACK和END_STREAM是同一位，分别用在SETTINGS/PING和DATA/HEADERS上
+enum
+{
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+// 错误码(RFC 9113 7)
+enum
+{
+    H2_NO_ERROR = 0x0,
+    H2_PROTOCOL_ERROR = 0x1,
+    H2_INTERNAL_ERROR = 0x2,
+    H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_STREAM_CLOSED = 0x5,
+    H2_FRAME_SIZE_ERROR = 0x6,
+    H2_REFUSED_STREAM = 0x7,
+    H2_COMPRESSION_ERROR = 0x9,
+    H2_ENHANCE_YOUR_CALM = 0xb
+};
+
+// SETTINGS参数
+enum
+{
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+static uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(std::string &out, uint32_t v)
+{
+    out += (char)(v >> 24);
+    out += (char)(v >> 16);
+    out += (char)(v >> 8);
+    out += (char)v;
+}
+
+static void putSetting(std::string &out, uint16_t id, uint32_t value)
+{
+    out += (char)(id >> 8);
+    out += (char)id;
+    put32(out, value);
+}
+
+// HTTP2-Settings头部是不带填充的base64url
+static bool base64urlDecode(std::string_view in, std::string &out)
+{
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : in)
+    {
+        int v;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if (c == '-')
+            v = 62;
+        else if (c == '_')
+            v = 63;
+        else if (c == '=')
+            break;
+        else
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out += (char)(acc >> bits);
+        }
+    }
+    return true;
+}
+
+/* HTTP/1.1格式的响应头换成HPACK头部块：状态行换成:status，名字改成小写，
+   去掉HTTP/2里不允许出现的逐跳头部(Connection、Keep-Alive等)。头部格式不对返回-1 */
+static int convertHead(std::string_view head, std::string &block)
+{
+    if (head.size() < 12 || head.compare(0, 5, "HTTP/") != 0)
+        return -1;
+    size_t sp = head.find(' ');
+    if (sp == std::string_view::npos || sp + 4 > head.size())
+        return -1;
+    int status = 0;
+    for (size_t i = sp + 1; i < sp + 4; ++i)
+    {
+        if (head[i] < '0' || head[i] > '9')
+            return -1;
+        status = status * 10 + head[i] - '0';
+    }
+    hpackEncodeStatus(status, block);
+    size_t pos = head.find("\r\n");
+    while (pos != std::string_view::npos)
+    {
+        pos += 2;
+        size_t eol = head.find("\r\n", pos);
+        if (eol == std::string_view::npos || eol == pos) // 头部结尾的空行
+            break;
+        std::string_view line = head.substr(pos, eol - pos);
+        pos = eol;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+            continue;
+        std::string name(line.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ')
+            value.remove_prefix(1);
+        if (name == "connection" || name == "keep-alive" || name == "transfer-encoding"
+            || name == "upgrade" || name == "proxy-connection")
+            continue;
+        hpackEncodeHeader(name, value, block);
+    }
+    return 0;
+}
+
+Http2Session::Http2Session(const std::string &_path):
+    path(_path),
+    preface_ok(false),
+    goaway_received(false),
+    last_stream_id(0),
+    last_sent(0),
+    header_stream(0),
+    header_end_stream(false),
+    conn_send_window(H2_DEFAULT_WINDOW),
+    conn_recv_window(H2_DEFAULT_WINDOW),
+    peer_initial_window(H2_DEFAULT_WINDOW),
+    peer_max_frame(H2_MAX_FRAME_SIZE)
+{
+}
+
+Http2Session::~Http2Session()
+{
+}
+
+void Http2Session::writeFrameHeader(size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    pending += (char)(len >> 16);
+    pending += (char)(len >> 8);
+    pending += (char)len;
+    pending += (char)type;
+    pending += (char)flags;
+    put32(pending, id & 0x7fffffff);
+}
+
+void Http2Session::writeFrame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload)
+{
+    writeFrameHeader(payload.size(), type, flags, id);
+    pending.append(payload.data(), payload.size());
+}
+
+void Http2Session::flushPending(std::deque<OutChunk> &out)
+{
+    if (pending.empty())
+        return;
+    std::shared_ptr<std::string> frames(new std::string);
+    frames->swap(pending);
+    OutChunk chunk;
+    chunk.data = frames->data();
+    chunk.len = frames->size();
+    chunk.owner = frames;
+    out.push_back(chunk);
+}
+
+int Http2Session::goAway(uint32_t error)
+{
+    std::string payload;
+    put32(payload, last_stream_id);
+    put32(payload, error);
+    writeFrame(FRAME_GOAWAY, 0, 0, payload);
+    return -1;
+}
+
+void Http2Session::resetStream(uint32_t id, uint32_t error)
+{
+    std::string payload;
+    put32(payload, error);
+    writeFrame(FRAME_RST_STREAM, 0, id, payload);
+}
+
+void Http2Session::start(std::deque<OutChunk> &out)
+{
+    std::string settings;
+    putSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, H2_MAX_CONCURRENT_STREAMS);
+    putSetting(settings, SETTINGS_INITIAL_WINDOW_SIZE, H2_RECV_WINDOW);
+    putSetting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, H2_MAX_HEADER_LIST);
+    writeFrame(FRAME_SETTINGS, 0, 0, settings);
+    // 连接的接收窗口不能用SETTINGS改，直接用WINDOW_UPDATE加上去
+    std::string increment;
+    put32(increment, H2_RECV_WINDOW - H2_DEFAULT_WINDOW);
+    writeFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+    conn_recv_window = H2_RECV_WINDOW;
+    flushPending(out);
+}
+
+int Http2Session::upgrade(std::string_view settings, const std::vector<HpackHeader> &request, std::deque<OutChunk> &out)
+{
+    std::string raw;
+    // 不合法就不升级，什么都不发，由调用者按HTTP/1.1应答
+    if (!base64urlDecode(settings, raw) || raw.size() % 6 != 0
+        || applySettings(reinterpret_cast<const uint8_t*>(raw.data()), raw.size()) < 0)
+    {
+        pending.clear();
+        return -1;
+    }
+    pending = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    start(out);
+    last_stream_id = 1;
+    Stream *s = openStream(1);
+    s->remote_closed = true;
+    s->req->beginStream(request);
+    respond(1, *s);
+    pumpData(out);
+    flushPending(out);
+    return 0;
+}
+
+int Http2Session::onInput(InputBuffer &input, std::deque<OutChunk> &out)
+{
+    int ret = 0;
+    if (!preface_ok)
+    {
+        size_t n = input.size() < H2_PREFACE_LEN ? input.size() : H2_PREFACE_LEN;
+        if (memcmp(input.peek(), H2_PREFACE, n) != 0)
+            ret = goAway(H2_PROTOCOL_ERROR);
+        else if (n == H2_PREFACE_LEN)
+        {
+            input.consume(H2_PREFACE_LEN);
+            preface_ok = true;
+        }
+    }
+    while (ret == 0 && preface_ok && input.size() >= H2_FRAME_HEADER_LEN)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(input.peek());
+        size_t len = ((size_t)p[0] << 16) | ((size_t)p[1] << 8) | p[2];
+        if (len > H2_MAX_FRAME_SIZE)
+        {
+            ret = goAway(H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if (input.size() < H2_FRAME_HEADER_LEN + len) // 半个帧，等后面的数据
+            break;
+        ret = onFrame(p[3], p[4], get32(p + 5) & 0x7fffffff, p + H2_FRAME_HEADER_LEN, len);
+        input.consume(H2_FRAME_HEADER_LEN + len);
+    }
+    if (ret == 0)
+        pumpData(out);
+    flushPending(out);
+    if (ret == 0 && goaway_received && streams.empty())
+        ret = -1;
+    return ret;
+}
+
+int Http2Session::onFrame(uint8_t type, uint8_t flags, uint32_t id, const uint8_t *p, size_t len)
+{
+    // 头部块没收齐之前中间不能插别的帧
+    if (header_stream != 0 && type != FRAME_CONTINUATION)
+        return goAway(H2_PROTOCOL_ERROR);
+    switch (type)
+    {
+    case FRAME_DATA:
+    case FRAME_HEADERS:
+    {
+        if (id == 0 || (type == FRAME_HEADERS && id % 2 == 0))
+            return goAway(H2_PROTOCOL_ERROR);
+        size_t frame_len = len; // 流控按整个帧计算，包括填充
+        if (flags & FLAG_PADDED)
+        {
+            if (len < 1 || p[0] >= len)
+                return goAway(H2_PROTOCOL_ERROR);
+            len -= 1 + p[0];
+            ++p;
+        }
+        if (type == FRAME_DATA)
+            return onData(id, flags & FLAG_END_STREAM, p, len, frame_len);
+        if (flags & FLAG_PRIORITY) // 优先级不用，跳过
+        {
+            if (len < 5)
+                return goAway(H2_PROTOCOL_ERROR);
+            p += 5;
+            len -= 5;
+        }
+        header_block.assign(reinterpret_cast<const char*>(p), len);
+        header_end_stream = flags & FLAG_END_STREAM;
+        if (!(flags & FLAG_END_HEADERS))
+        {
+            header_stream = id;
+            return 0;
+        }
+        return onHeaders(id, header_end_stream);
+    }
+    case FRAME_CONTINUATION:
+        if (header_stream == 0 || id != header_stream)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (header_block.size() + len > H2_MAX_HEADER_LIST)
+            return goAway(H2_ENHANCE_YOUR_CALM);
+        header_block.append(reinterpret_cast<const char*>(p), len);
+        if (!(flags & FLAG_END_HEADERS))
+            return 0;
+        header_stream = 0;
+        return onHeaders(id, header_end_stream);
+    case FRAME_PRIORITY:
+        if (id == 0)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (len != 5)
+            return goAway(H2_FRAME_SIZE_ERROR);
+        return 0;
+    case FRAME_RST_STREAM:
+        if (id == 0 || id > last_stream_id)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (len != 4)
+            return goAway(H2_FRAME_SIZE_ERROR);
+        streams.erase(id); // 请求的处理对象随之析构，上传了一半的文件也删掉
+        return 0;
+    case FRAME_SETTINGS:
+        if (id != 0)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (flags & FLAG_ACK)
+            return len == 0 ? 0 : goAway(H2_FRAME_SIZE_ERROR);
+        if (len % 6 != 0)
+            return goAway(H2_FRAME_SIZE_ERROR);
+        if (applySettings(p, len) < 0)
+            return -1;
+        writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, std::string_view());
+        return 0;
+    case FRAME_PING:
+        if (id != 0)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (len != 8)
+            return goAway(H2_FRAME_SIZE_ERROR);
+        if (!(flags & FLAG_ACK))
+            writeFrame(FRAME_PING, FLAG_ACK, 0, std::string_view(reinterpret_cast<const char*>(p), len));
+        return 0;
+    case FRAME_GOAWAY:
+        if (id != 0)
+            return goAway(H2_PROTOCOL_ERROR);
+        goaway_received = true;
+        return 0;
+    case FRAME_WINDOW_UPDATE:
+    {
+        if (len != 4)
+            return goAway(H2_FRAME_SIZE_ERROR);
+        int64_t increment = get32(p) & 0x7fffffff;
+        if (id == 0)
+        {
+            if (increment == 0)
+                return goAway(H2_PROTOCOL_ERROR);
+            if (conn_send_window + increment > H2_MAX_WINDOW)
+                return goAway(H2_FLOW_CONTROL_ERROR);
+            conn_send_window += increment;
+            return 0;
+        }
+        auto it = streams.find(id);
+        if (it == streams.end()) // 已经关闭的流，忽略
+            return 0;
+        if (increment == 0 || it->second.send_window + increment > H2_MAX_WINDOW)
+        {
+            resetStream(id, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+            streams.erase(it);
+            return 0;
+        }
+        it->second.send_window += increment;
+        return 0;
+    }
+    case FRAME_PUSH_PROMISE: // 客户端不能推送
+        return goAway(H2_PROTOCOL_ERROR);
+    default: // 不认识的帧类型按规定忽略
+        return 0;
+    }
+}
+
+int Http2Session::applySettings(const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = (p[i] << 8) | p[i + 1];
+        uint32_t value = get32(p + i + 2);
+        if (id == SETTINGS_ENABLE_PUSH && value > 1)
+            return goAway(H2_PROTOCOL_ERROR);
+        if (id == SETTINGS_INITIAL_WINDOW_SIZE)
+        {
+            if (value > (uint32_t)H2_MAX_WINDOW)
+                return goAway(H2_FLOW_CONTROL_ERROR);
+            // 新的初始窗口对已经打开的流也生效，按差值调整，窗口可以变成负的
+            int64_t delta = (int64_t)value - peer_initial_window;
+            for (auto &it : streams)
+            {
+                if (it.second.send_window + delta > H2_MAX_WINDOW)
+                    return goAway(H2_FLOW_CONTROL_ERROR);
+                it.second.send_window += delta;
+            }
+            peer_initial_window = value;
+        }
+        else if (id == SETTINGS_MAX_FRAME_SIZE)
+        {
+            if (value < H2_MAX_FRAME_SIZE || value > 0xffffff)
+                return goAway(H2_PROTOCOL_ERROR);
+            peer_max_frame = value;
+        }
+        // HEADER_TABLE_SIZE只影响编码方的动态表，服务器不用动态表编码，其他参数也不用管
+    }
+    return 0;
+}
+
+Http2Session::Stream *Http2Session::openStream(uint32_t id)
+{
+    Stream &s = streams[id];
+    s.req.reset(new requestData(NULL, -1, path));
+    s.send_window = peer_initial_window;
+    s.recv_window = H2_RECV_WINDOW;
+    s.remote_closed = false;
+    s.responded = false;
+    return &s;
+}
+
+int Http2Session::onHeaders(uint32_t id, bool end_stream)
+{
+    // 头部块不管要不要都得解码，不然动态表就和客户端对不上了
+    std::vector<HpackHeader> fields;
+    int ret = decoder.decode(reinterpret_cast<const uint8_t*>(header_block.data()), header_block.size(),
+                             H2_MAX_HEADER_LIST, fields);
+    header_block.clear();
+    if (ret < 0)
+        return goAway(H2_COMPRESSION_ERROR);
+    auto it = streams.find(id);
+    if (it != streams.end()) // 请求体后面的trailer，内容不用，只是结束请求
+    {
+        Stream &s = it->second;
+        if (s.remote_closed)
+            return goAway(H2_STREAM_CLOSED);
+        if (!end_stream)
+            return goAway(H2_PROTOCOL_ERROR);
+        s.remote_closed = true;
+        if (!s.responded)
+            respond(id, s);
+        return 0;
+    }
+    if (id <= last_stream_id) // 流号只能增加，旧的流已经关闭了
+        return goAway(H2_STREAM_CLOSED);
+    last_stream_id = id;
+    if (streams.size() >= H2_MAX_CONCURRENT_STREAMS)
+    {
+        resetStream(id, H2_REFUSED_STREAM);
+        return 0;
+    }
+    Stream *s = openStream(id);
+    s->remote_closed = end_stream;
+    if (s->req->beginStream(fields) < 0 || end_stream)
+        respond(id, *s);
+    return 0;
+}
+
+int Http2Session::onData(uint32_t id, bool end_stream, const uint8_t *p, size_t len, size_t frame_len)
+{
+    // 连接的窗口对所有DATA帧都要算，包括已经关闭的流上的
+    conn_recv_window -= frame_len;
+    if (conn_recv_window < 0)
+        return goAway(H2_FLOW_CONTROL_ERROR);
+    if (conn_recv_window <= H2_RECV_WINDOW / 2)
+    {
+        std::string increment;
+        put32(increment, H2_RECV_WINDOW - conn_recv_window);
+        writeFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+        conn_recv_window = H2_RECV_WINDOW;
+    }
+    auto it = streams.find(id);
+    if (it == streams.end())
+        return id > last_stream_id ? goAway(H2_PROTOCOL_ERROR) : 0; // 已经重置或应答完的流，数据丢掉
+    Stream &s = it->second;
+    if (s.remote_closed)
+        return goAway(H2_STREAM_CLOSED);
+    s.recv_window -= frame_len;
+    if (s.recv_window < 0)
+        return goAway(H2_FLOW_CONTROL_ERROR);
+    if (s.responded) // 已经回了错误页，剩下的请求体丢掉
+        return 0;
+    if (len > 0 && s.req->streamBody(reinterpret_cast<const char*>(p), len) < 0)
+    {
+        respond(id, s);
+        return 0;
+    }
+    if (end_stream)
+    {
+        s.remote_closed = true;
+        respond(id, s);
+    }
+    else if (s.recv_window <= H2_RECV_WINDOW / 2)
+    {
+        std::string increment;
+        put32(increment, H2_RECV_WINDOW - s.recv_window);
+        writeFrame(FRAME_WINDOW_UPDATE, 0, id, increment);
+        s.recv_window = H2_RECV_WINDOW;
+    }
+    return 0;
+}
+
+void Http2Session::respond(uint32_t id, Stream &s)
+{
+    std::deque<OutChunk> chunks;
+    s.req->finishStream(chunks);
+    s.req.reset(); // 请求体和解析状态都用不着了，正文块由各自的owner保活
+    s.responded = true;
+    std::string block;
+    if (chunks.empty() || chunks.front().data == NULL
+        || convertHead(std::string_view(chunks.front().data, chunks.front().len), block) < 0)
+    {
+        // 没有响应说明请求本身不合法(方法不支持、没有:path等)
+        resetStream(id, chunks.empty() ? H2_PROTOCOL_ERROR : H2_INTERNAL_ERROR);
+        streams.erase(id);
+        return;
+    }
+    // 整块拼好的响应(预先拼好的错误页)头部后面紧跟着正文，剩下的部分留作第一块正文
+    std::string_view head(chunks.front().data, chunks.front().len);
+    size_t head_end = head.find("\r\n\r\n");
+    if (head_end != std::string_view::npos && head_end + 4 < head.size())
+    {
+        chunks.front().data += head_end + 4;
+        chunks.front().len -= head_end + 4;
+    }
+    else
+        chunks.pop_front();
+    size_t body_len = 0;
+    for (auto &chunk : chunks)
+        body_len += chunk.len;
+    // 头部块超过对方的最大帧就拆成HEADERS加若干CONTINUATION
+    size_t off = 0;
+    uint8_t type = FRAME_HEADERS;
+    do
+    {
+        size_t n = std::min(block.size() - off, peer_max_frame);
+        uint8_t flags = off + n == block.size() ? FLAG_END_HEADERS : 0;
+        if (type == FRAME_HEADERS && body_len == 0)
+            flags |= FLAG_END_STREAM;
+        writeFrame(type, flags, id, std::string_view(block.data() + off, n));
+        off += n;
+        type = FRAME_CONTINUATION;
+    } while (off < block.size());
+    if (body_len == 0)
+    {
+        finishStream(id);
+        return;
+    }
+    for (auto &chunk : chunks)
+    {
+        if (chunk.len > 0)
+            s.data.push_back(chunk);
+    }
+}
+
+void Http2Session::pumpData(std::deque<OutChunk> &out)
+{
+    while (conn_send_window > 0 && !streams.empty())
+    {
+        // 从上一帧所属的流后面开始找下一个有正文、窗口也没用完的流，各个流轮流发
+        auto it = streams.upper_bound(last_sent);
+        bool found = false;
+        for (size_t i = 0; i < streams.size(); ++i, ++it)
+        {
+            if (it == streams.end())
+                it = streams.begin();
+            if (!it->second.data.empty() && it->second.send_window > 0)
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+        uint32_t id = it->first;
+        Stream &s = it->second;
+        OutChunk &chunk = s.data.front();
+        size_t n = std::min({chunk.len, peer_max_frame, (size_t)conn_send_window, (size_t)s.send_window});
+        bool last = n == chunk.len && s.data.size() == 1;
+        // 切出这一帧的正文，文件块只是挪偏移，仍然从页缓存发送
+        OutChunk piece = chunk;
+        piece.len = n;
+        chunk.len -= n;
+        if (chunk.data)
+            chunk.data += n;
+        else
+            chunk.file_off += n;
+        if (chunk.len == 0)
+            s.data.pop_front();
+        conn_send_window -= n;
+        s.send_window -= n;
+        last_sent = id;
+        writeFrameHeader(n, FRAME_DATA, last ? FLAG_END_STREAM : 0, id);
+        flushPending(out);
+        out.push_back(piece);
+        if (last)
+            finishStream(id);
+    }
+}
+
+void Http2Session::finishStream(uint32_t id)
+{
+    auto it = streams.find(id);
+    if (it == streams.end())
+        return;
+    if (!it->second.remote_closed) // 请求体还没收完就应答了，告诉对方不用再发
+        resetStream(id, H2_NO_ERROR);
+    streams.erase(it);
+}
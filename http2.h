@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <map>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "poller.h"
+#include "inputBuffer.h"
+#include "hpack.h"
+
+const size_t H2_PREFACE_LEN = 24;              // 客户端连接前言 "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" 的长度
+const size_t H2_FRAME_HEADER_LEN = 9;
+const size_t H2_MAX_FRAME_SIZE = 16384;        // 服务器接收的最大帧，不改默认值
+const int32_t H2_DEFAULT_WINDOW = 65535;       // 流控窗口的初始值
+const int32_t H2_RECV_WINDOW = 1 << 20;        // 服务器给每个流和整个连接通告的接收窗口，上传不用每64KB等一次WINDOW_UPDATE
+const int32_t H2_MAX_WINDOW = 0x7fffffff;
+const size_t H2_MAX_CONCURRENT_STREAMS = 128;  // 同时打开的流，再多回REFUSED_STREAM
+const size_t H2_MAX_HEADER_LIST = 65536;       // 一个请求解码后头部的总大小上限，和HTTP/1.x的MAX_HEADER_BYTES一致
+
+extern const char H2_PREFACE[];
+
+class requestData;
+
+/* 一个HTTP/2明文(h2c)连接。连接的requestData读到数据后整段交给onInput，
+   这里拆帧、维护HPACK解码表和两个方向的流控窗口；每个流是一个没有socket的requestData，
+   请求行和头部由HEADERS帧里的伪头部换来，POST的DATA帧边收边交给它的请求体处理，
+   所以静态文件、Range、上传这些处理和HTTP/1.x完全是同一套代码。
+   流的响应仍是HTTP/1.1格式的头部加正文块：头部换成HPACK编码的HEADERS帧，
+   正文块按窗口和对方的最大帧切成DATA帧，各个流轮流发一帧，文件块切片后仍走sendfile */
+class Http2Session
+{
+private:
+    struct Stream
+    {
+        std::shared_ptr<requestData> req;
+        int32_t send_window;        // 还能发给对方的字节数
+        int32_t recv_window;        // 还允许对方发来的字节数
+        bool remote_closed;         // 收到了END_STREAM
+        bool responded;             // 响应头已经发出，正文在data里；请求体没收完就应答的，发完用RST_STREAM(NO_ERROR)让对方别再发
+        std::deque<OutChunk> data;  // 还没发出的响应正文
+    };
+
+    std::string path;               // 网站根目录，交给各个流的requestData
+    bool preface_ok;                // 已经收到客户端的连接前言
+    bool goaway_received;           // 对方不再开新流，现有的流应答完就关闭连接
+    uint32_t last_stream_id;        // 已经开过的最大流号
+    std::map<uint32_t, Stream> streams;
+    uint32_t last_sent;             // 上一帧DATA属于的流，轮转从它后面开始
+    HpackDecoder decoder;
+    std::string header_block;       // HEADERS后面跟着CONTINUATION时攒起来的头部块
+    uint32_t header_stream;         // 正在攒头部块的流，0表示没有
+    bool header_end_stream;         // 那个HEADERS帧带了END_STREAM
+    int32_t conn_send_window;
+    int32_t conn_recv_window;
+    int32_t peer_initial_window;    // 对方SETTINGS_INITIAL_WINDOW_SIZE，新流的发送窗口
+    size_t peer_max_frame;          // 对方SETTINGS_MAX_FRAME_SIZE，发出的帧不能超过它
+    std::string pending;            // 攒着的控制帧和DATA帧头，放进发送队列前合成一块
+
+    void writeFrameHeader(size_t len, uint8_t type, uint8_t flags, uint32_t id);
+    void writeFrame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload);
+    void flushPending(std::deque<OutChunk> &out);
+    int goAway(uint32_t error);                 // 连接错误：发GOAWAY后关闭，返回-1
+    void resetStream(uint32_t id, uint32_t error);
+    int applySettings(const uint8_t *p, size_t len);
+    int onFrame(uint8_t type, uint8_t flags, uint32_t id, const uint8_t *p, size_t len);
+    int onHeaders(uint32_t id, bool end_stream);     // 头部块收齐了
+    int onData(uint32_t id, bool end_stream, const uint8_t *p, size_t len, size_t frame_len);
+    Stream *openStream(uint32_t id);
+    void respond(uint32_t id, Stream &s);       // 请求收完(或中途出错)，取出流的响应写成HEADERS帧，正文排进data
+    void pumpData(std::deque<OutChunk> &out);   // 按窗口把各个流的正文写成DATA帧
+    void finishStream(uint32_t id);             // 正文发完，两个方向都结束的流删掉
+
+public:
+    explicit Http2Session(const std::string &_path);
+    ~Http2Session();
+    // 服务器的连接前言(SETTINGS)，prior knowledge时收到客户端前言、Upgrade时发出101之后调用
+    void start(std::deque<OutChunk> &out);
+    /* HTTP/1.1 Upgrade: h2c。settings是HTTP2-Settings头部的base64url，
+       request是升级的那个请求，成为流1(对方已经半关闭)；之后客户端还要再发连接前言 */
+    int upgrade(std::string_view settings, const std::vector<HpackHeader> &request, std::deque<OutChunk> &out);
+    // 处理输入缓冲区里完整的帧，半个帧留到下次；要关闭连接时返回-1(GOAWAY已经在out里)
+    int onInput(InputBuffer &input, std::deque<OutChunk> &out);
+};
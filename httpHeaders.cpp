@@ -0,0 +1,112 @@
+#include "httpHeaders.h"
+#include "perfectHash.h"
+
+static constexpr std::array<std::string_view, HDR_COUNT> header_names = {
+    "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language", "Authorization",
+    "Cache-Control", "Connection", "Content-Encoding", "Content-Length", "Content-Type",
+    "Cookie", "Date", "Expect", "Forwarded", "Host", "HTTP2-Settings",
+    "If-Match", "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since",
+    "Keep-Alive", "Origin", "Pragma", "Range", "Referer", "TE", "Transfer-Encoding",
+    "Upgrade", "User-Agent", "Via", "X-Forwarded-For", "X-Real-IP"
+};
+
+static constexpr std::array<std::string_view, MTH_COUNT> method_names = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"
+};
+
+static constexpr auto header_table = buildPerfectHash<HDR_COUNT / 2, 64>(header_names);
+static constexpr auto method_table = buildPerfectHash<MTH_COUNT / 2, 16>(method_names);
+static_assert(header_table.ok && method_table.ok, "duplicate header or method name");
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (phLower(a[i]) != phLower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+HeaderId lookupHeader(std::string_view name)
+{
+    int id = header_table.find(name);
+    return id >= 0 && equalsIgnoreCase(name, header_names[id]) ? static_cast<HeaderId>(id) : HDR_UNKNOWN;
+}
+
+std::string_view headerName(HeaderId id)
+{
+    return id >= 0 && id < HDR_COUNT ? header_names[id] : std::string_view();
+}
+
+MethodId lookupMethod(std::string_view name)
+{
+    int id = method_table.find(name);
+    return id >= 0 && name == method_names[id] ? static_cast<MethodId>(id) : MTH_UNKNOWN;
+}
+
+HttpHeaders::HttpHeaders():
+    present(0),
+    other_num(0)
+{
+}
+
+void HttpHeaders::clear()
+{
+    present = 0;
+    other_num = 0;
+}
+
+void HttpHeaders::add(std::string_view name, std::string_view value)
+{
+    HeaderId id = lookupHeader(name);
+    if (id != HDR_UNKNOWN)
+    {
+        std::string &slot = known[id];
+        if (has(id))
+        {
+            slot.append(", ");
+            slot.append(value.data(), value.size());
+        }
+        else
+        {
+            slot.assign(value.data(), value.size()); // 复用上一个请求留下的容量
+            present |= 1ULL << id;
+        }
+        return;
+    }
+    for (size_t i = 0; i < other_num; ++i)
+    {
+        if (equalsIgnoreCase(others[i].first, name))
+        {
+            others[i].second.append(", ");
+            others[i].second.append(value.data(), value.size());
+            return;
+        }
+    }
+    if (other_num == others.size())
+        others.emplace_back();
+    others[other_num].first.assign(name.data(), name.size());
+    others[other_num].second.assign(value.data(), value.size());
+    ++other_num;
+}
+
+const std::string *HttpHeaders::get(std::string_view name) const
+{
+    HeaderId id = lookupHeader(name);
+    if (id != HDR_UNKNOWN)
+        return get(id);
+    for (size_t i = 0; i < other_num; ++i)
+    {
+        if (equalsIgnoreCase(others[i].first, name))
+            return &others[i].second;
+    }
+    return NULL;
+}
+
+size_t HttpHeaders::size() const
+{
+    return __builtin_popcountll(present) + other_num;
+}
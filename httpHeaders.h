@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+// 服务器认识的标准头部，每个在HttpHeaders里有固定的槽位
+enum HeaderId
+{
+    HDR_ACCEPT = 0,
+    HDR_ACCEPT_CHARSET,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_AUTHORIZATION,
+    HDR_CACHE_CONTROL,
+    HDR_CONNECTION,
+    HDR_CONTENT_ENCODING,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_COOKIE,
+    HDR_DATE,
+    HDR_EXPECT,
+    HDR_FORWARDED,
+    HDR_HOST,
+    HDR_HTTP2_SETTINGS,
+    HDR_IF_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_RANGE,
+    HDR_IF_UNMODIFIED_SINCE,
+    HDR_KEEP_ALIVE,
+    HDR_ORIGIN,
+    HDR_PRAGMA,
+    HDR_RANGE,
+    HDR_REFERER,
+    HDR_TE,
+    HDR_TRANSFER_ENCODING,
+    HDR_UPGRADE,
+    HDR_USER_AGENT,
+    HDR_VIA,
+    HDR_X_FORWARDED_FOR,
+    HDR_X_REAL_IP,
+    HDR_COUNT,
+    HDR_UNKNOWN = -1
+};
+
+// 标准的请求方法
+enum MethodId
+{
+    MTH_GET = 0,
+    MTH_HEAD,
+    MTH_POST,
+    MTH_PUT,
+    MTH_DELETE,
+    MTH_CONNECT,
+    MTH_OPTIONS,
+    MTH_TRACE,
+    MTH_PATCH,
+    MTH_COUNT,
+    MTH_UNKNOWN = -1
+};
+
+// 头部名字和方法名都查编译期建好的完美哈希表(perfectHash.h)，不加锁、不分配内存
+// 头部名字不区分大小写，不认识的返回HDR_UNKNOWN
+HeaderId lookupHeader(std::string_view name);
+std::string_view headerName(HeaderId id);
+MethodId lookupMethod(std::string_view name);   // 方法名区分大小写，不认识的返回MTH_UNKNOWN
+bool equalsIgnoreCase(std::string_view a, std::string_view b);
+
+/* 一个请求的头部。认识的头部按HeaderId放进固定槽位，取值是一次数组下标；
+   不认识的放进一个小的平铺数组，线性查找。clear()只清长度不释放内存，
+   长连接上后面的请求复用同样的string和数组，正常情况下解析头部不再分配内存 */
+class HttpHeaders
+{
+private:
+    std::string known[HDR_COUNT];
+    uint64_t present;   // 第i位表示known[i]有值
+    std::vector<std::pair<std::string, std::string>> others;
+    size_t other_num;   // others里前other_num个有效
+
+public:
+    HttpHeaders();
+    void clear();
+    // 同名头部出现多次时按RFC 7230用逗号连起来
+    void add(std::string_view name, std::string_view value);
+    bool has(HeaderId id) const { return present & (1ULL << id); }
+    const std::string *get(HeaderId id) const { return has(id) ? &known[id] : NULL; }
+    const std::string *get(std::string_view name) const; // 按名字找，也能找到不认识的头部
+    size_t size() const;
+};
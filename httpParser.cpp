@@ -0,0 +1,207 @@
+#include "httpParser.h"
+#include <immintrin.h>
+
+// 在[p, end)里找第一个等于a、b或c的字节，没有返回end
+typedef const char *(*FindAnyFunc)(const char *p, const char *end, char a, char b, char c);
+
+static const char *findAnyScalar(const char *p, const char *end, char a, char b, char c)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == a || *p == b || *p == c)
+            return p;
+    }
+    return end;
+}
+
+// pcmpestri一条指令比较16个字节和最多16个候选字符
+__attribute__((target("sse4.2")))
+static const char *findAnySse42(const char *p, const char *end, char a, char b, char c)
+{
+    const __m128i needle = _mm_setr_epi8(a, b, c, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(needle, 3, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return p + idx;
+        p += 16;
+    }
+    return findAnyScalar(p, end, a, b, c);
+}
+
+// 32个字节分别和三个字符比较，结果合成一个位掩码，最低的置位就是第一个命中的位置
+__attribute__((target("avx2")))
+static const char *findAnyAvx2(const char *p, const char *end, char a, char b, char c)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                      _mm256_cmpeq_epi8(v, vc));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return findAnySse42(p, end, a, b, c); // 不足32字节的尾巴再试一次16字节
+}
+
+static ParserImpl bestImpl()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return PARSER_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return PARSER_SSE42;
+    return PARSER_SCALAR;
+}
+
+static FindAnyFunc implFunc(ParserImpl impl)
+{
+    switch (impl)
+    {
+        case PARSER_AVX2:
+            return findAnyAvx2;
+        case PARSER_SSE42:
+            return findAnySse42;
+        default:
+            return findAnyScalar;
+    }
+}
+
+static ParserImpl cur_impl = bestImpl();
+static FindAnyFunc find_any = implFunc(cur_impl);
+
+ParserImpl parserImpl()
+{
+    return cur_impl;
+}
+
+bool setParserImpl(ParserImpl impl)
+{
+    if (impl > bestImpl()) // AVX2的CPU一定支持SSE4.2
+        return false;
+    cur_impl = impl;
+    find_any = implFunc(impl);
+    return true;
+}
+
+const char *parserImplName(ParserImpl impl)
+{
+    switch (impl)
+    {
+        case PARSER_AVX2:
+            return "avx2";
+        case PARSER_SSE42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+// q指向行尾的CR或LF，返回行尾的长度(LF为1，CRLF为2)；CR后面还没收到字节返回0，CR后面不是LF返回-1
+static int eolLen(const char *q, const char *end)
+{
+    if (*q == '\n')
+        return 1;
+    if (q + 1 == end)
+        return 0;
+    return q[1] == '\n' ? 2 : -1;
+}
+
+size_t findHeaderEnd(const char *buf, size_t len, size_t from)
+{
+    const char *p = buf + (from > 2 ? from - 2 : 0);
+    const char *end = buf + len;
+    while ((p = find_any(p, end, '\n', '\n', '\n')) != end)
+    {
+        // LF后面紧跟LF或者CRLF就是空行
+        if (p + 1 < end && p[1] == '\n')
+            return p + 2 - buf;
+        if (p + 2 < end && p[1] == '\r' && p[2] == '\n')
+            return p + 3 - buf;
+        ++p;
+    }
+    return 0;
+}
+
+int parseHttpRequest(const char *buf, size_t len, HttpRequestView &req)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    req.num_headers = 0;
+    // 请求前面多余的空行忽略掉
+    while (p < end && (*p == '\r' || *p == '\n'))
+        ++p;
+
+    // 请求行：方法 空格 目标 空格 版本
+    const char *q = find_any(p, end, ' ', '\r', '\n');
+    if (q == end)
+        return PARSE_REQUEST_INCOMPLETE;
+    if (*q != ' ' || q == p)
+        return PARSE_REQUEST_ERROR;
+    req.method = std::string_view(p, q - p);
+    p = q + 1;
+    q = find_any(p, end, ' ', '\r', '\n');
+    if (q == end)
+        return PARSE_REQUEST_INCOMPLETE;
+    if (*q != ' ' || q == p)
+        return PARSE_REQUEST_ERROR;
+    req.target = std::string_view(p, q - p);
+    p = q + 1;
+    q = find_any(p, end, '\r', '\n', '\n');
+    if (q == end)
+        return PARSE_REQUEST_INCOMPLETE;
+    req.version = std::string_view(p, q - p);
+    if (req.version.size() != 8 || req.version.compare(0, 7, "HTTP/1.") != 0
+        || req.version[7] < '0' || req.version[7] > '9')
+        return PARSE_REQUEST_ERROR;
+    req.minor_version = req.version[7] - '0';
+    int eol = eolLen(q, end);
+    if (eol <= 0)
+        return eol == 0 ? PARSE_REQUEST_INCOMPLETE : PARSE_REQUEST_ERROR;
+    p = q + eol;
+
+    // 头部：名字 冒号 值，一直到空行
+    while (true)
+    {
+        if (p == end)
+            return PARSE_REQUEST_INCOMPLETE;
+        if (*p == '\r' || *p == '\n') // 空行，头部结束
+        {
+            eol = eolLen(p, end);
+            if (eol <= 0)
+                return eol == 0 ? PARSE_REQUEST_INCOMPLETE : PARSE_REQUEST_ERROR;
+            return p + eol - buf;
+        }
+        if (req.num_headers == MAX_HTTP_HEADERS)
+            return PARSE_REQUEST_ERROR;
+        q = find_any(p, end, ':', '\r', '\n');
+        if (q == end)
+            return PARSE_REQUEST_INCOMPLETE;
+        // 名字不能为空，冒号前也不能有空白(会被前后不同的解析器理解成不同的头部)
+        if (*q != ':' || q == p || q[-1] == ' ' || q[-1] == '\t')
+            return PARSE_REQUEST_ERROR;
+        HttpHeaderView &h = req.headers[req.num_headers];
+        h.name = std::string_view(p, q - p);
+        p = q + 1;
+        q = find_any(p, end, '\r', '\n', '\n');
+        if (q == end)
+            return PARSE_REQUEST_INCOMPLETE;
+        const char *value_end = q;
+        while (p < value_end && (*p == ' ' || *p == '\t'))
+            ++p;
+        while (value_end > p && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+            --value_end;
+        h.value = std::string_view(p, value_end - p);
+        ++req.num_headers;
+        eol = eolLen(q, end);
+        if (eol <= 0)
+            return eol == 0 ? PARSE_REQUEST_INCOMPLETE : PARSE_REQUEST_ERROR;
+        p = q + eol;
+    }
+}
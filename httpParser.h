@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string_view>
+#include <stddef.h>
+
+const int MAX_HTTP_HEADERS = 64;            // 一个请求最多接受的头部行数，再多按格式错误处理
+const size_t MAX_HEADER_BYTES = 65536;      // 请求行加头部的最大字节数，超过了回431
+const int PARSE_REQUEST_INCOMPLETE = -1;    // 请求行和头部还没收全，等更多数据再解析
+const int PARSE_REQUEST_ERROR = -2;         // 格式错误
+
+// 一行头部，name和value都指向连接的输入缓冲区，value已去掉两边的空白
+struct HttpHeaderView
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// 解析出的请求行和头部，全部是输入缓冲区里的视图，不拷贝也不分配内存，缓冲区写入新数据前有效
+struct HttpRequestView
+{
+    std::string_view method;
+    std::string_view target;    // 请求行里的目标，如 /index.html?a=1
+    std::string_view version;   // 如 HTTP/1.1
+    int minor_version;          // HTTP/1.x 的 x
+    HttpHeaderView headers[MAX_HTTP_HEADERS];
+    int num_headers;
+};
+
+/* 解析buf开头的请求行和全部头部，成功返回它们占的字节数(请求体从这里开始)，
+   没收全返回PARSE_REQUEST_INCOMPLETE，格式错误返回PARSE_REQUEST_ERROR。
+   找CR/LF/冒号/空格用SIMD一次比较16或32字节，按CPU支持在运行时选AVX2、SSE4.2或者逐字节的实现 */
+int parseHttpRequest(const char *buf, size_t len, HttpRequestView &req);
+
+/* 在buf里找头部结尾的空行，返回请求行加头部的总长度，还没收到返回0。
+   from是上次已经找过的长度，这次从它前面两个字节(空行可能被上次的结尾截断)接着找，
+   每个字节只看一次，头部一个字节一个字节地到达时总的查找量也只和收到的字节数成正比。
+   buf开头不能有请求之间多余的空行 */
+size_t findHeaderEnd(const char *buf, size_t len, size_t from);
+
+enum ParserImpl
+{
+    PARSER_SCALAR = 0,
+    PARSER_SSE42,
+    PARSER_AVX2
+};
+
+ParserImpl parserImpl();                    // 当前使用的实现，默认是CPU支持的最快的那个
+bool setParserImpl(ParserImpl impl);        // 换一种实现(压测对比用)，CPU不支持时返回false
+const char *parserImplName(ParserImpl impl);
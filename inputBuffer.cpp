@@ -0,0 +1,113 @@
+#include "inputBuffer.h"
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+InputBuffer::InputBuffer():
+    buf(NULL),
+    cap(0),
+    head(0),
+    len(0)
+{
+}
+
+InputBuffer::~InputBuffer()
+{
+    free(buf);
+}
+
+void InputBuffer::reserve(size_t new_cap)
+{
+    char *new_buf = static_cast<char*>(malloc(new_cap));
+    if (len > 0)
+    {
+        // 分两段拷贝：head到环尾，环头到数据结尾
+        size_t first = cap - head < len ? cap - head : len;
+        memcpy(new_buf, buf + head, first);
+        memcpy(new_buf + first, buf, len - first);
+    }
+    free(buf);
+    buf = new_buf;
+    cap = new_cap;
+    head = 0;
+}
+
+const char *InputBuffer::peek()
+{
+    if (head + len > cap) // 跨过环尾了，整理成连续的
+        reserve(cap);
+    return buf + head;
+}
+
+// 只移动偏移，不释放内存，之前peek()拿到的视图仍然有效
+void InputBuffer::consume(size_t n)
+{
+    if (n >= len) // 读空了，偏移归零，下次读进来的数据从头放，不会跨环尾
+    {
+        head = 0;
+        len = 0;
+        return;
+    }
+    head = (head + n) & (cap - 1);
+    len -= n;
+}
+
+void InputBuffer::clear()
+{
+    free(buf);
+    buf = NULL;
+    cap = 0;
+    head = 0;
+    len = 0;
+}
+
+void InputBuffer::append(const char *data, size_t n)
+{
+    if (cap - len < n)
+    {
+        size_t new_cap = cap ? cap : INPUT_BUFF_INIT;
+        while (new_cap - len < n)
+            new_cap <<= 1;
+        reserve(new_cap);
+    }
+    size_t tail = (head + len) & (cap - 1);
+    size_t first = cap - tail < n ? cap - tail : n;
+    memcpy(buf + tail, data, first);
+    memcpy(buf, data + first, n - first);
+    len += n;
+}
+
+ssize_t InputBuffer::readFd(int fd, size_t max_cap)
+{
+    if (cap == 0 || (len == 0 && cap > INPUT_BUFF_SHRINK)) // 还没分配，或者大请求处理完了，回到初始容量
+        reserve(INPUT_BUFF_INIT);
+    else if (len == cap && cap < max_cap) // 上次读满了，socket里可能还有更多，扩容
+        reserve(cap << 1);
+    ssize_t readSum = 0;
+    while (len < cap)
+    {
+        // 空闲空间从数据结尾开始，可能绕回环头，分成两段一次readv读进去
+        struct iovec iov[2];
+        size_t tail = (head + len) & (cap - 1);
+        size_t space = cap - len;
+        iov[0].iov_base = buf + tail;
+        iov[0].iov_len = cap - tail < space ? cap - tail : space;
+        iov[1].iov_base = buf;
+        iov[1].iov_len = space - iov[0].iov_len;
+        ssize_t n = readv(fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return readSum;
+            return -1;
+        }
+        if (n == 0) // 对端关闭
+            break;
+        len += n;
+        readSum += n;
+    }
+    return readSum;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+const size_t INPUT_BUFF_INIT = 4096;        // 连接第一次读数据时分配的容量
+const size_t INPUT_BUFF_SHRINK = 65536;     // 读空时容量超过这个值就缩回INPUT_BUFF_INIT，大请求过后不一直占着内存
+const size_t INPUT_BUFF_HEADER_MAX = 131072;    // 等头部时容量最多长到这么大，比MAX_HEADER_BYTES大，读满还没有头部结尾就能判成431
+const size_t INPUT_BUFF_BODY_MAX = 65536;       // 收请求体或HTTP/2帧时容量最多这么大，读满就先交出去，不把整个socket读进内存
+
+/* 连接的输入缓冲区，环形，容量是2的幂。
+   read时用readv直接读进空闲空间(空闲区跨过环尾时分成两段)，不经过栈上缓冲和string拼接；
+   解析时用peek()拿到可读数据的连续视图，用完consume()只移动偏移，不搬数据。
+   可读数据跨过环尾时peek()才整理成连续的一段，读空时偏移归零，常见的一问一答基本不会跨环尾；
+   读满了容量翻倍，但不超过调用者给的上限，到了上限就要先解析、消费掉再读；读空时按INPUT_BUFF_SHRINK缩回去 */
+class InputBuffer
+{
+private:
+    char *buf;
+    size_t cap;     // 容量，0表示还没分配
+    size_t head;    // 可读数据的起点
+    size_t len;     // 可读字节数
+
+    void reserve(size_t new_cap); // 换一块new_cap大小的内存，可读数据整理到开头
+
+public:
+    InputBuffer();
+    ~InputBuffer();
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    bool full() const { return cap > 0 && len == cap; }
+    size_t capacity() const { return cap; }
+    const char *peek();                         // 可读数据的连续视图，长度为size()，下次写入数据前有效
+    void consume(size_t n);                     // 丢掉前n个已经解析过的字节
+    void clear();                               // 丢掉全部数据并释放内存
+    void append(const char *data, size_t n);    // 追加别处已经收到的数据(io_uring)
+    // 读到EAGAIN、对端关闭或者空闲空间读满为止，返回读到的字节数，出错返回-1；上次读满时扩容，容量最多到max_cap
+    ssize_t readFd(int fd, size_t max_cap);
+
+private:
+    InputBuffer(const InputBuffer &);
+    InputBuffer &operator=(const InputBuffer &);
+};
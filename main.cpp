@@ -3,11 +3,14 @@
 #include "threadpool.h"
 #include "util.h"
 #include "log.h"
+#include "fileCache.h"
 #include <sys/epoll.h>
 #include <queue>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <cstdlib>
@@ -15,6 +18,9 @@
 #include <vector>
 #include <unistd.h>
 #include <memory>
+#include <sys/prctl.h>
+#include <errno.h>
+#include <time.h>
 
 using namespace std;
 
@@ -31,12 +37,9 @@ const string PATH = "/";
 const int TIMER_TIME_OUT = 500; // 定时器延时500毫秒
 
 
-void acceptConnection(int listen_fd, int epoll_fd, const string &path);
-
-extern std::priority_queue<shared_ptr<mytimer>, std::deque<shared_ptr<mytimer>>, timerCmp> myTimerQueue;
-
 // 封装一下创建、绑定、监听，返回配置完的监听描述符listen_fd
-int socket_bind_listen(int port)
+// reuse_port为true时额外设置SO_REUSEPORT，多个worker进程各自绑定同一端口，由内核在它们之间均衡分配新连接
+int socket_bind_listen(int port, bool reuse_port)
 {
     // 检查port值，取正确区间范围
     if (port < 1024 || port > 65535)
@@ -51,6 +54,8 @@ int socket_bind_listen(int port)
     int optval = 1;
     if(setsockopt(listen_fd, SOL_SOCKET,  SO_REUSEADDR, &optval, sizeof(optval)) == -1)
         return -1;
+    if(reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1)
+        return -1;
 
     // 设置服务器IP和Port，和监听描述符绑定
     struct sockaddr_in server_addr;
@@ -74,59 +79,38 @@ int socket_bind_listen(int port)
     return listen_fd;
 }
 
-// 检查定时器队列，将已删除或超时的定时器弹出释放
-void handle_expired_event()
+// 单个服务进程：创建事件循环、线程池(或子reactor)和监听socket，然后一直循环
+int run_server(int port, int reactor_num, bool reuse_port, const string &backend)
 {
-    MutexLockGuard lock; //创建并加锁，开始操作定时器优先队列
-    while (!myTimerQueue.empty()) //队列不为空
-    {
-        shared_ptr<mytimer> ptimer_now = myTimerQueue.top(); 
-        if (ptimer_now->isDeleted()) //如果队列顶的定时器已经被删除，则弹出并释放
-        {
-            myTimerQueue.pop();
-            //delete ptimer_now; 当前函数结束后栈上的锁也会自动析构
-        }
-        else if (ptimer_now->isvalid() == false) //如果队列顶的定时器已经超时，则弹出并释放
-        {
-            myTimerQueue.pop();
-            //delete ptimer_now;
-        }
-        else //最近的定时器都未超时，直接跳出结束
-        {
-            break;
-        }
-    }
-}
-
-int main(int argc, char *argv[])
-{
-    // 命令行参数获取 端口 和 server提供的目录
-    if (argc < 3) 
-    {
-    	printf("./server port path\n");	
-    }
-    // 获取用户输入的端口 
-    int port = atoi(argv[1]);
-    // 改变进程工作目录，决定服务器要建在哪个目录下
-    int ret = chdir(argv[2]);
-    if (ret != 0) {
-    	perror("chdir error");	
-    	exit(1);
-    }
-    handle_for_sigpipe(); //忽略SIGPIPE信号，防止任意浏览器断开导致服务器进程退出，在util.cpp中
-    if (Epoll::epoll_init(MAXEVENTS, LISTENQ) < 0) //创建epoll句柄（内核事件表）并初始化epoll
+    // 静态文件缓存每个进程一份，监视线程在fork之后才能建
+    if (FileCacheMgr::GetInstance()->start() < 0)
+        printf("File cache disabled\n");
+    Epoll main_loop; // 主线程的事件循环
+    if (main_loop.epoll_init(MAXEVENTS, LISTENQ, backend) < 0) //创建轮询器(epoll句柄或io_uring)并初始化
     {
         perror("epoll init failed");
         return 1;
     }
+    if (reactor_num > 0)
+    {
+        // 多reactor模式：主循环只负责accept，新连接轮流分给各子reactor
+        if (main_loop.start_sub_loops(reactor_num, MAXEVENTS, LISTENQ) < 0)
+        {
+            perror("sub reactor start failed");
+            return 1;
+        }
+    }
+    // io_uring的提交和收割只能在一个线程里，单reactor时连接直接在主线程处理，不用线程池
+    else if (main_loop.ownsIO())
+        main_loop.setInLoop(true);
     // 创建一个初始线程池
-    if (ThreadPool::threadpool_create(THREADPOOL_THREAD_NUM, QUEUE_SIZE) < 0) //创建出错会返回-1
+    else if (ThreadPool::threadpool_create(THREADPOOL_THREAD_NUM, QUEUE_SIZE) < 0) //创建出错会返回-1
     {
         printf("Threadpool create failed\n");
         return 1;
     }
     // socket()、bind()、listen()
-    int listen_fd = socket_bind_listen(port);
+    int listen_fd = socket_bind_listen(port, reuse_port);
     if (listen_fd < 0) 
     {
         perror("socket bind failed");
@@ -138,20 +122,168 @@ int main(int argc, char *argv[])
         perror("set socket non block failed");
         return 1;
     }
-    shared_ptr<requestData> request(new requestData()); //用智能指针接收一个实例化请求对象
-    request->setFd(listen_fd);//将该对象绑定lfd
-    if (Epoll::epoll_add(listen_fd, request, EPOLLIN | EPOLLET) < 0) //监听事件上树
+    if (main_loop.epoll_add_listener(listen_fd) < 0) //监听事件上树
     {
         perror("epoll add error");
         return 1;
     }
-    // 服务器启动日志
-    LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Server started ! port:"<<argv[1]<<" path:"<<argv[2];
     // 主线程开始循环监控
-    while (true)
+    main_loop.loop(listen_fd, -1); // 封装了epoll_wait，timerfd响了再处理超时的连接
+    return 0;
+}
+
+static volatile sig_atomic_t supervisor_quit = 0;
+static void supervisor_signal(int)
+{
+    supervisor_quit = 1;
+}
+
+// fork出第index个worker进程，绑定到分给它的那一组CPU核上运行一个完整的服务
+static pid_t spawn_worker(int index, int worker_num, int port, int reactor_num, const string &backend)
+{
+    pid_t pid = fork();
+    if (pid != 0) // 父进程(supervisor)或fork失败
+        return pid;
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM); // supervisor退出时worker跟着退出
+    if (bindToCpuShare(index, worker_num) < 0)
+        perror("bind cpu failed");
+    LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Worker "<<index<<" started, pid:"<<getpid();
+    exit(run_server(port, reactor_num, true, backend));
+}
+
+/* 多进程模式：supervisor进程fork出worker_num个worker，每个worker有自己的SO_REUSEPORT监听socket、
+   事件循环和线程池，互不共享任何锁；worker被信号杀死(崩溃)时重新拉起，正常退出(如bind失败)则不再拉起 */
+int run_workers(int worker_num, int port, int reactor_num, const string &backend)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = supervisor_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    vector<pid_t> workers(worker_num, -1);
+    vector<time_t> started(worker_num, 0);
+    for (int i = 0; i < worker_num; ++i)
+    {
+        workers[i] = spawn_worker(i, worker_num, port, reactor_num, backend);
+        started[i] = time(NULL);
+    }
+    int alive = worker_num;
+    while (alive > 0 && !supervisor_quit)
+    {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        int index = -1;
+        for (int i = 0; i < worker_num; ++i)
+        {
+            if (workers[i] == pid)
+                index = i;
+        }
+        if (index < 0)
+            continue;
+        if (!WIFSIGNALED(status)) // 正常退出说明是启动失败等不可恢复的错误，不再重启
+        {
+            LOG_ERROR(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Worker "<<index<<" exited with status "<<WEXITSTATUS(status);
+            workers[index] = -1;
+            --alive;
+            continue;
+        }
+        LOG_ERROR(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Worker "<<index<<" killed by signal "<<WTERMSIG(status)<<", restarting";
+        if (time(NULL) - started[index] < 1) // 刚启动就崩溃，稍等一下避免疯狂fork
+            sleep(1);
+        workers[index] = spawn_worker(index, worker_num, port, reactor_num, backend);
+        started[index] = time(NULL);
+    }
+    // supervisor收到退出信号，通知所有worker退出
+    for (int i = 0; i < worker_num; ++i)
     {
-        Epoll::my_epoll_wait(listen_fd, MAXEVENTS, -1); // 封装了epoll_wait，多了打印异常信息
-        handle_expired_event(); // 主线程每次还检查下定时器队列
+        if (workers[i] > 0)
+            kill(workers[i], SIGTERM);
     }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
     return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // 命令行参数获取 端口 和 server提供的目录
+    if (argc < 3) 
+    {
+    	printf("./server port path [--reactors N] [--workers N] [--poller epoll|uring] [--filesend sendfile|splice|mmap]"
+               " [--body-spill BYTES] [--body-mem BYTES] [--body-tmpdir DIR] [--upload-dir DIR]"
+               " [--file-cache BYTES] [--file-cache-max BYTES] [--fd-cache N] [--gzip-level N]\n");	
+        return 1;
+    }
+    // 可选参数：--reactors N 开启多reactor模式，N个子reactor线程各自处理自己的连接，不再使用线程池
+    //          --workers N 开启多进程模式，N个worker进程各自监听同一端口(SO_REUSEPORT)，允许的CPU核平分给各worker
+    //          --poller epoll|uring 选择轮询器后端，默认epoll
+    //          --filesend sendfile|splice|mmap 静态文件正文的发送方式，默认sendfile
+    //          --body-spill BYTES 单个请求体超过这么大就转存到临时文件，默认1MB
+    //          --body-mem BYTES 所有连接的请求体最多占用的内存，超过后新到的请求体都写临时文件，默认64MB
+    //          --body-tmpdir DIR 请求体临时文件所在目录，默认/tmp
+    //          --upload-dir DIR multipart/form-data上传的非图片文件保存到这个已有目录，默认不保存
+    //          --file-cache BYTES 静态文件内容缓存的总大小，默认64MB，0表示不缓存
+    //          --file-cache-max BYTES 超过这么大的文件不读进内存，默认1MB
+    //          --fd-cache N 最多缓存这么多个大文件打开的fd，默认256，0表示不缓存
+    //          --gzip-level N 缓存里可压缩的小文件在线压缩的级别(1-9)，默认6，0表示不在线压缩(.gz文件照样发)
+    int reactor_num = 0;
+    int worker_num = 0;
+    string backend = "epoll";
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--reactors") == 0)
+            reactor_num = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--workers") == 0)
+            worker_num = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--poller") == 0)
+            backend = argv[i + 1];
+        else if (strcmp(argv[i], "--filesend") == 0)
+        {
+            if (strcmp(argv[i + 1], "mmap") == 0)
+                Poller::file_mode = FILE_SEND_MMAP;
+            else if (strcmp(argv[i + 1], "splice") == 0)
+                Poller::file_mode = FILE_SEND_SPLICE;
+            else
+                Poller::file_mode = FILE_SEND_SENDFILE;
+        }
+        else if (strcmp(argv[i], "--body-spill") == 0)
+            RequestBody::spill_threshold = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--body-mem") == 0)
+            RequestBody::mem_limit = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--body-tmpdir") == 0)
+            RequestBody::tmp_dir = argv[i + 1];
+        else if (strcmp(argv[i], "--upload-dir") == 0)
+            requestData::upload_dir = argv[i + 1];
+        else if (strcmp(argv[i], "--file-cache") == 0)
+            FileCache::capacity = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--file-cache-max") == 0)
+            FileCache::file_max = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--fd-cache") == 0)
+            FileCache::fd_max = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--gzip-level") == 0)
+            FileCache::gzip_level = atoi(argv[i + 1]);
+    }
+    // 获取用户输入的端口 
+    int port = atoi(argv[1]);
+    // 改变进程工作目录，决定服务器要建在哪个目录下
+    int ret = chdir(argv[2]);
+    if (ret != 0) {
+    	perror("chdir error");	
+    	exit(1);
+    }
+    handle_for_sigpipe(); //忽略SIGPIPE信号，防止任意浏览器断开导致服务器进程退出，在util.cpp中
+    // 服务器启动日志
+    LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Server started ! port:"<<argv[1]<<" path:"<<argv[2];
+    if (worker_num > 0)
+        return run_workers(worker_num, port, reactor_num, backend);
+    return run_server(port, reactor_num, false, backend);
 }
\ No newline at end of file
@@ -0,0 +1,763 @@
+#include "mimeType.h"
+#include "perfectHash.h"
+
+struct MimeEntry
+{
+    std::string_view ext;   // 小写，不带点
+    std::string_view type;
+};
+
+// 整理自发行版的mime.types，去掉了少见的厂商私有类型，补上了Web常用的几种(mjs、webmanifest、m3u8等)
+static constexpr MimeEntry mime_entries[] = {
+    {"1clr", "application/clr"},
+    {"3mf", "application/vnd.ms-3mfdocument"},
+    {"7z", "application/x-7z-compressed"},
+    {"a2l", "application/A2L"},
+    {"aa3", "audio/ATRAC3"},
+    {"aac", "audio/aac"},
+    {"aal", "audio/ATRAC-ADVANCED-LOSSLESS"},
+    {"ac", "application/pkix-attr-cert"},
+    {"ac3", "audio/ac3"},
+    {"acn", "audio/asc"},
+    {"adts", "audio/aac"},
+    {"ai", "application/postscript"},
+    {"aif", "audio/x-aiff"},
+    {"aifc", "audio/x-aiff"},
+    {"aiff", "audio/x-aiff"},
+    {"aml", "application/AML"},
+    {"amlx", "application/automationml-amlx+zip"},
+    {"amr", "audio/AMR"},
+    {"anx", "application/annodex"},
+    {"apk", "application/vnd.android.package-archive"},
+    {"apng", "image/apng"},
+    {"appcache", "text/cache-manifest"},
+    {"apxml", "application/auth-policy+xml"},
+    {"art", "image/x-jg"},
+    {"asc", "application/pgp-keys"},
+    {"asf", "application/vnd.ms-asf"},
+    {"ass", "audio/aac"},
+    {"at3", "audio/ATRAC3"},
+    {"atf", "application/ATF"},
+    {"atfx", "application/ATFX"},
+    {"atom", "application/atom+xml"},
+    {"atomcat", "application/atomcat+xml"},
+    {"atomdeleted", "application/atomdeleted+xml"},
+    {"atomsrv", "application/atomserv+xml"},
+    {"atomsvc", "application/atomsvc+xml"},
+    {"atx", "audio/ATRAC-X"},
+    {"atxml", "application/ATXML"},
+    {"au", "audio/basic"},
+    {"auc", "application/tamp-apex-update-confirm"},
+    {"avci", "image/avci"},
+    {"avcs", "image/avcs"},
+    {"avi", "video/x-msvideo"},
+    {"avif", "image/avif"},
+    {"awb", "audio/AMR-WB"},
+    {"axa", "audio/annodex"},
+    {"axv", "video/annodex"},
+    {"bak", "application/x-trash"},
+    {"bat", "application/x-msdos-program"},
+    {"bib", "text/x-bibtex"},
+    {"bin", "application/octet-stream"},
+    {"bmp", "image/bmp"},
+    {"boo", "text/x-boo"},
+    {"brf", "text/plain"},
+    {"btf", "image/prs.btif"},
+    {"btif", "image/prs.btif"},
+    {"bz2", "application/x-bzip2"},
+    {"c", "text/x-csrc"},
+    {"c++", "text/x-c++src"},
+    {"c3ex", "application/cccex"},
+    {"cab", "application/vnd.ms-cab-compressed"},
+    {"cat", "application/vnd.ms-pki.seccat"},
+    {"cbor", "application/cbor"},
+    {"cc", "text/x-c++src"},
+    {"ccmp", "application/ccmp+xml"},
+    {"ccxml", "application/ccxml+xml"},
+    {"cda", "application/x-cdf"},
+    {"cdf", "application/x-cdf"},
+    {"cdfx", "application/CDFX+XML"},
+    {"cdmia", "application/cdmi-capability"},
+    {"cdmic", "application/cdmi-container"},
+    {"cdmid", "application/cdmi-domain"},
+    {"cdmio", "application/cdmi-object"},
+    {"cdmiq", "application/cdmi-queue"},
+    {"cdr", "image/x-coreldraw"},
+    {"cdt", "image/x-coreldrawtemplate"},
+    {"cea", "application/CEA"},
+    {"cellml", "application/cellml+xml"},
+    {"cer", "application/pkix-cert"},
+    {"cgm", "image/cgm"},
+    {"chm", "application/vnd.ms-htmlhelp"},
+    {"cil", "application/vnd.ms-artgalry"},
+    {"cjs", "text/javascript"},
+    {"cl", "application/simple-filter+xml"},
+    {"class", "application/java-vm"},
+    {"cls", "text/x-tex"},
+    {"clue", "application/clue_info+xml"},
+    {"cml", "application/cellml+xml"},
+    {"cmsc", "application/cms"},
+    {"cnd", "text/jcr-cnd"},
+    {"com", "application/x-msdos-program"},
+    {"copyright", "text/vnd.debian.copyright"},
+    {"coswid", "application/swid+cbor"},
+    {"cpio", "application/x-cpio"},
+    {"cpl", "application/cpl+xml"},
+    {"cpp", "text/x-c++src"},
+    {"cpt", "application/mac-compactpro"},
+    {"cql", "text/cql"},
+    {"cr2", "image/x-canon-cr2"},
+    {"crl", "application/pkix-crl"},
+    {"crt", "application/x-x509-ca-cert"},
+    {"crw", "image/x-canon-crw"},
+    {"csd", "audio/csound"},
+    {"csh", "text/x-csh"},
+    {"csrattrs", "application/csrattrs"},
+    {"css", "text/css"},
+    {"csv", "text/csv"},
+    {"csvs", "text/csv-schema"},
+    {"cu", "application/cu-seeme"},
+    {"cuc", "application/tamp-community-update-confirm"},
+    {"cw", "application/prs.cww"},
+    {"cwl", "application/cwl"},
+    {"cwl.json", "application/cwl+json"},
+    {"cww", "application/prs.cww"},
+    {"cxx", "text/x-c++src"},
+    {"d", "text/x-dsrc"},
+    {"davmount", "application/davmount+xml"},
+    {"dcd", "application/DCD"},
+    {"dcm", "application/dicom"},
+    {"dcr", "application/x-director"},
+    {"ddeb", "application/vnd.debian.binary-package"},
+    {"deb", "application/vnd.debian.binary-package"},
+    {"deploy", "application/octet-stream"},
+    {"dif", "video/dv"},
+    {"diff", "text/x-diff"},
+    {"dii", "application/DII"},
+    {"dir", "application/x-director"},
+    {"dist", "application/vnd.apple.installer+xml"},
+    {"distz", "application/vnd.apple.installer+xml"},
+    {"dit", "application/DIT"},
+    {"djv", "image/vnd.djvu"},
+    {"djvu", "image/vnd.djvu"},
+    {"dll", "application/x-msdos-program"},
+    {"dls", "audio/dls"},
+    {"dmg", "application/x-apple-diskimage"},
+    {"doc", "application/msword"},
+    {"docm", "application/vnd.ms-word.document.macroEnabled.12"},
+    {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+    {"dotm", "application/vnd.ms-word.template.macroEnabled.12"},
+    {"dotx", "application/vnd.openxmlformats-officedocument.wordprocessingml.template"},
+    {"dpx", "image/dpx"},
+    {"drle", "image/dicom-rle"},
+    {"dsc", "text/prs.lines.tag"},
+    {"dssc", "application/dssc+der"},
+    {"dtd", "application/xml-dtd"},
+    {"dv", "video/dv"},
+    {"dvc", "application/dvcs"},
+    {"dvi", "application/x-dvi"},
+    {"dwd", "application/atsc-dwd+xml"},
+    {"dwg", "image/vnd.dwg"},
+    {"dxf", "image/vnd.dxf"},
+    {"dxr", "application/x-director"},
+    {"efi", "application/efi"},
+    {"emf", "image/emf"},
+    {"emma", "application/emma+xml"},
+    {"emotionml", "application/emotionml+xml"},
+    {"ent", "application/xml-external-parsed-entity"},
+    {"enw", "audio/EVRCNW"},
+    {"eot", "application/vnd.ms-fontobject"},
+    {"eps", "application/postscript"},
+    {"eps2", "application/postscript"},
+    {"eps3", "application/postscript"},
+    {"epsf", "application/postscript"},
+    {"epsi", "application/postscript"},
+    {"epub", "application/epub+zip"},
+    {"erf", "image/x-epson-erf"},
+    {"es", "text/javascript"},
+    {"etx", "text/x-setext"},
+    {"evb", "audio/EVRCB"},
+    {"evc", "audio/EVRC"},
+    {"evw", "audio/EVRCWB"},
+    {"exe", "application/x-msdos-program"},
+    {"exi", "application/exi"},
+    {"exp", "application/express"},
+    {"exr", "image/aces"},
+    {"ez", "application/andrew-inset"},
+    {"fcdt", "application/vnd.adobe.formscentral.fcdt"},
+    {"fdf", "application/fdf"},
+    {"fdt", "application/fdt+xml"},
+    {"finf", "application/fastinfoset"},
+    {"fit", "image/fits"},
+    {"fits", "image/fits"},
+    {"flac", "audio/flac"},
+    {"fli", "video/fli"},
+    {"flv", "video/x-flv"},
+    {"fts", "image/fits"},
+    {"fxp", "application/vnd.adobe.fxp"},
+    {"fxpl", "application/vnd.adobe.fxp"},
+    {"gbr", "application/rpki-ghostbusters"},
+    {"gcd", "text/x-pcs-gcd"},
+    {"geojson", "application/geo+json"},
+    {"gf", "application/x-tex-gf"},
+    {"gff3", "text/gff3"},
+    {"gif", "image/gif"},
+    {"gl", "video/gl"},
+    {"glbin", "application/gltf-buffer"},
+    {"glbuf", "application/gltf-buffer"},
+    {"gml", "application/gml+xml"},
+    {"gpkg", "application/geopackage+sqlite3"},
+    {"gram", "application/srgs"},
+    {"grxml", "application/srgs+xml"},
+    {"gsf", "application/x-font"},
+    {"gsheet", "application/urc-grpsheet+xml"},
+    {"gsm", "audio/x-gsm"},
+    {"gtar", "application/x-gtar"},
+    {"gz", "application/gzip"},
+    {"h", "text/x-chdr"},
+    {"h++", "text/x-c++hdr"},
+    {"hdf", "application/x-hdf"},
+    {"heic", "image/heic"},
+    {"heics", "image/heic-sequence"},
+    {"heif", "image/heif"},
+    {"heifs", "image/heif-sequence"},
+    {"hej2", "image/hej2k"},
+    {"held", "application/atsc-held+xml"},
+    {"hh", "text/x-c++hdr"},
+    {"hif", "image/avif"},
+    {"hpp", "text/x-c++hdr"},
+    {"hpub", "application/prs.hpub+zip"},
+    {"hqx", "application/mac-binhex40"},
+    {"hs", "text/x-haskell"},
+    {"hsj2", "image/hsj2"},
+    {"hta", "application/hta"},
+    {"htc", "text/x-component"},
+    {"htm", "text/html"},
+    {"html", "text/html"},
+    {"hxx", "text/x-c++hdr"},
+    {"ico", "image/x-icon"},
+    {"ics", "text/calendar"},
+    {"ief", "image/ief"},
+    {"ifb", "text/calendar"},
+    {"ifc", "application/p21"},
+    {"ims", "application/vnd.ms-ims"},
+    {"ink", "application/inkml+xml"},
+    {"inkml", "application/inkml+xml"},
+    {"ipfix", "application/ipfix"},
+    {"iso", "application/x-iso9660-image"},
+    {"its", "application/its+xml"},
+    {"jar", "application/java-archive"},
+    {"java", "text/x-java"},
+    {"jfif", "image/jpeg"},
+    {"jhc", "image/jphc"},
+    {"jls", "image/jls"},
+    {"jng", "image/x-jng"},
+    {"jnlp", "application/x-java-jnlp-file"},
+    {"jp2", "image/jp2"},
+    {"jpe", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"jpf", "image/jpx"},
+    {"jpg", "image/jpeg"},
+    {"jpg2", "image/jp2"},
+    {"jpgm", "image/jpm"},
+    {"jph", "image/jph"},
+    {"jphc", "image/jphc"},
+    {"jpm", "image/jpm"},
+    {"jpx", "image/jpx"},
+    {"jrd", "application/jrd+json"},
+    {"js", "text/javascript"},
+    {"json", "application/json"},
+    {"json-patch", "application/json-patch+json"},
+    {"jsonld", "application/ld+json"},
+    {"jsontd", "application/td+json"},
+    {"jsontm", "application/tm+json"},
+    {"jsx", "text/javascript"},
+    {"jxl", "image/jxl"},
+    {"jxr", "image/jxr"},
+    {"jxra", "image/jxrA"},
+    {"jxrs", "image/jxrS"},
+    {"jxs", "image/jxs"},
+    {"jxsc", "image/jxsc"},
+    {"jxsi", "image/jxsi"},
+    {"jxss", "image/jxss"},
+    {"key", "application/pgp-keys"},
+    {"keynote", "application/vnd.apple.keynote"},
+    {"kml", "application/vnd.google-earth.kml+xml"},
+    {"kmz", "application/vnd.google-earth.kmz"},
+    {"ktx", "image/ktx"},
+    {"ktx2", "image/ktx2"},
+    {"l16", "audio/L16"},
+    {"latex", "application/x-latex"},
+    {"lbc", "audio/iLBC"},
+    {"lgr", "application/lgr+xml"},
+    {"lha", "application/x-lha"},
+    {"lhs", "text/x-literate-haskell"},
+    {"lin", "application/bbolin"},
+    {"loas", "audio/usac"},
+    {"lostsyncxml", "application/lostsync+xml"},
+    {"lostxml", "application/lost+xml"},
+    {"lpf", "application/lpf+zip"},
+    {"lrm", "application/vnd.ms-lrm"},
+    {"lsf", "video/x-la-asf"},
+    {"lsx", "video/x-la-asf"},
+    {"ltx", "text/x-tex"},
+    {"lxf", "application/LXF"},
+    {"ly", "text/x-lilypond"},
+    {"lzh", "application/x-lzh"},
+    {"lzx", "application/x-lzx"},
+    {"m1v", "video/mpeg"},
+    {"m21", "application/mp21"},
+    {"m2v", "video/mpeg"},
+    {"m3g", "application/m3g"},
+    {"m3u", "audio/mpegurl"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+    {"m4a", "audio/mp4"},
+    {"m4s", "video/iso.segment"},
+    {"m4v", "video/mp4"},
+    {"ma", "application/mathematica"},
+    {"mads", "application/mads+xml"},
+    {"maei", "application/mmt-aei+xml"},
+    {"manifest", "text/cache-manifest"},
+    {"map", "application/json"},
+    {"markdown", "text/markdown"},
+    {"mb", "application/mathematica"},
+    {"mbox", "application/mbox"},
+    {"md", "text/markdown"},
+    {"mdb", "application/msaccess"},
+    {"mdi", "image/vnd.ms-modi"},
+    {"meta4", "application/metalink4+xml"},
+    {"mets", "application/mets+xml"},
+    {"mf4", "application/MF4"},
+    {"mft", "application/rpki-manifest"},
+    {"mhas", "audio/mhas"},
+    {"mid", "audio/sp-midi"},
+    {"miz", "text/mizar"},
+    {"mj2", "video/mj2"},
+    {"mjp2", "video/mj2"},
+    {"mjs", "text/javascript"},
+    {"mkv", "video/x-matroska"},
+    {"mml", "application/mathml+xml"},
+    {"mng", "video/x-mng"},
+    {"moc", "text/x-moc"},
+    {"mod", "application/xml-dtd"},
+    {"mods", "application/mods+xml"},
+    {"mov", "video/quicktime"},
+    {"movie", "video/x-sgi-movie"},
+    {"mp1", "audio/mpeg"},
+    {"mp2", "audio/mpeg"},
+    {"mp21", "application/mp21"},
+    {"mp3", "audio/mpeg"},
+    {"mp4", "video/mp4"},
+    {"mpd", "application/dash+xml"},
+    {"mpdd", "application/dashdelta"},
+    {"mpe", "video/mpeg"},
+    {"mpeg", "video/mpeg"},
+    {"mpega", "audio/mpeg"},
+    {"mpf", "text/vnd.ms-mediapackage"},
+    {"mpg", "video/mpeg"},
+    {"mpg4", "video/mp4"},
+    {"mpga", "audio/mpeg"},
+    {"mpkg", "application/vnd.apple.installer+xml"},
+    {"mpp", "application/vnd.ms-project"},
+    {"mpt", "application/vnd.ms-project"},
+    {"mpv", "video/x-matroska"},
+    {"mrc", "application/marc"},
+    {"mrcx", "application/marcxml+xml"},
+    {"msi", "application/x-msi"},
+    {"msp", "application/octet-stream"},
+    {"msu", "application/octet-stream"},
+    {"musd", "application/mmt-usd+xml"},
+    {"mxf", "application/mxf"},
+    {"mxmf", "audio/mobile-xmf"},
+    {"mxml", "application/xv+xml"},
+    {"n3", "text/n3"},
+    {"nc", "application/x-netcdf"},
+    {"nef", "image/x-nikon-nef"},
+    {"nq", "application/n-quads"},
+    {"nt", "application/n-triples"},
+    {"numbers", "application/vnd.apple.numbers"},
+    {"o", "application/x-object"},
+    {"oda", "application/ODA"},
+    {"odb", "application/vnd.oasis.opendocument.base"},
+    {"odc", "application/vnd.oasis.opendocument.chart"},
+    {"odd", "application/tei+xml"},
+    {"odf", "application/vnd.oasis.opendocument.formula"},
+    {"odg", "application/vnd.oasis.opendocument.graphics"},
+    {"odi", "application/vnd.oasis.opendocument.image"},
+    {"odm", "application/vnd.oasis.opendocument.text-master"},
+    {"odp", "application/vnd.oasis.opendocument.presentation"},
+    {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+    {"odt", "application/vnd.oasis.opendocument.text"},
+    {"odx", "application/ODX"},
+    {"oga", "audio/ogg"},
+    {"ogg", "audio/ogg"},
+    {"ogv", "video/ogg"},
+    {"ogx", "application/ogg"},
+    {"old", "application/x-trash"},
+    {"omg", "audio/ATRAC3"},
+    {"one", "application/onenote"},
+    {"onepkg", "application/onenote"},
+    {"onetmp", "application/onenote"},
+    {"onetoc2", "application/onenote"},
+    {"opf", "application/oebps-package+xml"},
+    {"opus", "audio/ogg"},
+    {"orc", "audio/csound"},
+    {"orf", "image/x-olympus-orf"},
+    {"orq", "application/ocsp-request"},
+    {"ors", "application/ocsp-response"},
+    {"otc", "application/vnd.oasis.opendocument.chart-template"},
+    {"otf", "font/otf"},
+    {"otg", "application/vnd.oasis.opendocument.graphics-template"},
+    {"oth", "application/vnd.oasis.opendocument.text-web"},
+    {"oti", "application/vnd.oasis.opendocument.image-template"},
+    {"otp", "application/vnd.oasis.opendocument.presentation-template"},
+    {"ots", "application/vnd.oasis.opendocument.spreadsheet-template"},
+    {"ott", "application/vnd.oasis.opendocument.text-template"},
+    {"oxps", "application/oxps"},
+    {"p", "text/x-pascal"},
+    {"p10", "application/pkcs10"},
+    {"p12", "application/pkcs12"},
+    {"p21", "application/p21"},
+    {"p7c", "application/pkcs7-mime"},
+    {"p7m", "application/pkcs7-mime"},
+    {"p7r", "application/x-pkcs7-certreqresp"},
+    {"p7s", "application/pkcs7-signature"},
+    {"p7z", "application/pkcs7-mime"},
+    {"p8", "application/pkcs8"},
+    {"p8e", "application/pkcs8-encrypted"},
+    {"pac", "application/x-ns-proxy-autoconfig"},
+    {"pages", "application/vnd.apple.pages"},
+    {"pas", "text/x-pascal"},
+    {"pat", "image/x-coreldrawpattern"},
+    {"patch", "text/x-diff"},
+    {"pbm", "image/x-portable-bitmap"},
+    {"pcf", "application/x-font-pcf"},
+    {"pcf.z", "application/x-font-pcf"},
+    {"pdf", "application/pdf"},
+    {"pdx", "application/PDX"},
+    {"pem", "application/pem-certificate-chain"},
+    {"pfa", "application/x-font"},
+    {"pfb", "application/x-font"},
+    {"pfr", "application/font-tdpfr"},
+    {"pfx", "application/pkcs12"},
+    {"pgm", "image/x-portable-graymap"},
+    {"pgp", "application/pgp-encrypted"},
+    {"pk", "application/x-tex-pk"},
+    {"pkg", "application/vnd.apple.installer+xml"},
+    {"pki", "application/pkixcmp"},
+    {"pkipath", "application/pkix-pkipath"},
+    {"pl", "text/x-perl"},
+    {"pls", "audio/x-scpls"},
+    {"pm", "text/x-perl"},
+    {"png", "image/png"},
+    {"pnm", "image/x-portable-anymap"},
+    {"pot", "text/plain"},
+    {"potm", "application/vnd.ms-powerpoint.template.macroEnabled.12"},
+    {"potx", "application/vnd.openxmlformats-officedocument.presentationml.template"},
+    {"ppam", "application/vnd.ms-powerpoint.addin.macroEnabled.12"},
+    {"ppm", "image/x-portable-pixmap"},
+    {"pps", "application/vnd.ms-powerpoint"},
+    {"ppsm", "application/vnd.ms-powerpoint.slideshow.macroEnabled.12"},
+    {"ppsx", "application/vnd.openxmlformats-officedocument.presentationml.slideshow"},
+    {"ppt", "application/vnd.ms-powerpoint"},
+    {"pptm", "application/vnd.ms-powerpoint.presentation.macroEnabled.12"},
+    {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+    {"prf", "application/pics-rules"},
+    {"provn", "text/provenance-notation"},
+    {"provx", "application/provenance+xml"},
+    {"ps", "application/postscript"},
+    {"psd", "image/vnd.adobe.photoshop"},
+    {"psid", "audio/prs.sid"},
+    {"pskcxml", "application/pskc+xml"},
+    {"pti", "image/prs.pti"},
+    {"py", "text/x-python"},
+    {"pya", "audio/vnd.ms-playready.media.pya"},
+    {"pyc", "application/x-python-code"},
+    {"pyo", "application/x-python-code"},
+    {"pyv", "video/vnd.ms-playready.media.pyv"},
+    {"qcp", "audio/EVRC-QCP"},
+    {"qt", "video/quicktime"},
+    {"ra", "audio/x-pn-realaudio"},
+    {"ram", "audio/x-pn-realaudio"},
+    {"rapd", "application/route-apd+xml"},
+    {"rar", "application/vnd.rar"},
+    {"ras", "image/x-cmu-raster"},
+    {"rb", "application/x-ruby"},
+    {"rct", "application/prs.nprend"},
+    {"rdf", "application/rdf+xml"},
+    {"rdf-crypt", "application/prs.rdf-xml-crypt"},
+    {"relo", "application/p2p-overlay+xml"},
+    {"rfcxml", "application/rfc+xml"},
+    {"rgb", "image/x-rgb"},
+    {"rif", "application/reginfo+xml"},
+    {"rl", "application/resource-lists+xml"},
+    {"rld", "application/resource-lists-diff+xml"},
+    {"rm", "audio/x-pn-realaudio"},
+    {"rnc", "application/relax-ng-compact-syntax"},
+    {"rnd", "application/prs.nprend"},
+    {"roa", "application/rpki-roa"},
+    {"roff", "text/troff"},
+    {"rpm", "application/x-redhat-package-manager"},
+    {"rq", "application/sparql-query"},
+    {"rs", "application/rls-services+xml"},
+    {"rsat", "application/atsc-rsat+xml"},
+    {"rsheet", "application/urc-ressheet+xml"},
+    {"rst", "text/prs.fallenstein.rst"},
+    {"rtf", "application/rtf"},
+    {"rusd", "application/route-usd+xml"},
+    {"sac", "application/tamp-sequence-adjust-confirm"},
+    {"sarif", "application/sarif+json"},
+    {"sarif-external-properties", "application/sarif-external-properties+json"},
+    {"sarif-external-properties.json", "application/sarif-external-properties+json"},
+    {"sarif.json", "application/sarif+json"},
+    {"scala", "text/x-scala"},
+    {"scim", "application/scim+json"},
+    {"sco", "audio/csound"},
+    {"scq", "application/scvp-cv-request"},
+    {"scr", "application/x-silverlight"},
+    {"scs", "application/scvp-cv-response"},
+    {"sd2", "audio/x-sd2"},
+    {"sdp", "application/sdp"},
+    {"senml", "application/senml+json"},
+    {"senml-etchc", "application/senml-etch+cbor"},
+    {"senml-etchj", "application/senml-etch+json"},
+    {"senmlc", "application/senml+cbor"},
+    {"senmle", "application/senml-exi"},
+    {"senmlx", "application/senml+xml"},
+    {"sensml", "application/sensml+json"},
+    {"sensmlc", "application/sensml+cbor"},
+    {"sensmle", "application/sensml-exi"},
+    {"sensmlx", "application/sensml+xml"},
+    {"ser", "application/java-serialized-object"},
+    {"sfv", "text/x-sfv"},
+    {"sgm", "text/SGML"},
+    {"sgml", "text/SGML"},
+    {"sh", "application/x-sh"},
+    {"shaclc", "text/shaclc"},
+    {"shar", "application/x-shar"},
+    {"shc", "text/shaclc"},
+    {"shex", "text/shex"},
+    {"shf", "application/shf+xml"},
+    {"shtml", "text/html"},
+    {"sid", "audio/prs.sid"},
+    {"sieve", "application/sieve"},
+    {"sig", "application/pgp-signature"},
+    {"sik", "application/x-trash"},
+    {"siv", "application/sieve"},
+    {"sldm", "application/vnd.ms-powerpoint.slide.macroEnabled.12"},
+    {"sldx", "application/vnd.openxmlformats-officedocument.presentationml.slide"},
+    {"sls", "application/route-s-tsid+xml"},
+    {"smi", "application/smil+xml"},
+    {"smil", "application/smil+xml"},
+    {"sml", "application/smil+xml"},
+    {"smv", "audio/SMV"},
+    {"snd", "audio/basic"},
+    {"soa", "text/dns"},
+    {"soc", "application/sgml-open-catalog"},
+    {"sofa", "audio/sofa"},
+    {"spdx", "text/spdx"},
+    {"spdx.json", "application/spdx+json"},
+    {"spl", "application/futuresplash"},
+    {"spp", "application/scvp-vp-response"},
+    {"spq", "application/scvp-vp-request"},
+    {"spx", "audio/ogg"},
+    {"sql", "application/sql"},
+    {"src", "application/x-wais-source"},
+    {"srt", "text/plain"},
+    {"sru", "application/sru+xml"},
+    {"srx", "application/sparql-results+xml"},
+    {"ssml", "application/ssml+xml"},
+    {"stc", "application/vnd.sun.xml.calc.template"},
+    {"std", "application/vnd.sun.xml.draw.template"},
+    {"sti", "application/vnd.sun.xml.impress.template"},
+    {"stix", "application/stix+json"},
+    {"stk", "application/hyperstudio"},
+    {"stpnc", "application/p21"},
+    {"stw", "application/vnd.sun.xml.writer.template"},
+    {"sty", "text/x-tex"},
+    {"svg", "image/svg+xml"},
+    {"svgz", "image/svg+xml"},
+    {"swf", "application/vnd.adobe.flash.movie"},
+    {"swidtag", "application/swid+xml"},
+    {"sxc", "application/vnd.sun.xml.calc"},
+    {"sxd", "application/vnd.sun.xml.draw"},
+    {"sxg", "application/vnd.sun.xml.writer.global"},
+    {"sxi", "application/vnd.sun.xml.impress"},
+    {"sxm", "application/vnd.sun.xml.math"},
+    {"sxw", "application/vnd.sun.xml.writer"},
+    {"t", "text/troff"},
+    {"tag", "text/prs.lines.tag"},
+    {"tar", "application/x-tar"},
+    {"tau", "application/tamp-apex-update"},
+    {"taz", "application/x-gtar-compressed"},
+    {"tcl", "application/x-tcl"},
+    {"tcu", "application/tamp-community-update"},
+    {"td", "application/urc-targetdesc+xml"},
+    {"tei", "application/tei+xml"},
+    {"teicorpus", "application/tei+xml"},
+    {"ter", "application/tamp-error"},
+    {"tex", "text/x-tex"},
+    {"texi", "application/x-texinfo"},
+    {"texinfo", "application/x-texinfo"},
+    {"text", "text/plain"},
+    {"tfi", "application/thraud+xml"},
+    {"tfx", "image/tiff-fx"},
+    {"tgz", "application/x-gtar-compressed"},
+    {"thmx", "application/vnd.ms-officetheme"},
+    {"tif", "image/tiff"},
+    {"tiff", "image/tiff"},
+    {"tk", "text/x-tcl"},
+    {"tm", "text/texmacs"},
+    {"tm.json", "application/tm+json"},
+    {"tm.jsonld", "application/tm+json"},
+    {"tnef", "application/vnd.ms-tnef"},
+    {"tnf", "application/vnd.ms-tnef"},
+    {"toml", "application/toml"},
+    {"torrent", "application/x-bittorrent"},
+    {"tr", "text/troff"},
+    {"trig", "application/trig"},
+    {"ts", "video/mp2t"},
+    {"tsa", "application/tamp-sequence-adjust"},
+    {"tsd", "application/timestamped-data"},
+    {"tsp", "application/dsptype"},
+    {"tsq", "application/timestamp-query"},
+    {"tsr", "application/timestamp-reply"},
+    {"tsv", "text/tab-separated-values"},
+    {"ttc", "font/collection"},
+    {"ttf", "font/ttf"},
+    {"ttl", "text/turtle"},
+    {"ttml", "application/ttml+xml"},
+    {"tuc", "application/tamp-update-confirm"},
+    {"tur", "application/tamp-update"},
+    {"txt", "text/plain"},
+    {"udeb", "application/vnd.debian.binary-package"},
+    {"uis", "application/urc-uisocketdesc+xml"},
+    {"uri", "text/uri-list"},
+    {"uris", "text/uri-list"},
+    {"vcard", "text/vcard"},
+    {"vcf", "text/vcard"},
+    {"vcj", "application/voucher-cms+json"},
+    {"vcs", "text/x-vcalendar"},
+    {"vis", "application/vnd.visionary"},
+    {"vsd", "application/vnd.visio"},
+    {"vss", "application/vnd.visio"},
+    {"vst", "application/vnd.visio"},
+    {"vsw", "application/vnd.visio"},
+    {"vtt", "text/vtt"},
+    {"vxml", "application/voicexml+xml"},
+    {"wasm", "application/wasm"},
+    {"wav", "audio/wav"},
+    {"wax", "audio/x-ms-wax"},
+    {"wbmp", "image/vnd.wap.wbmp"},
+    {"wcm", "application/vnd.ms-works"},
+    {"wdb", "application/vnd.ms-works"},
+    {"webm", "video/webm"},
+    {"webmanifest", "application/manifest+json"},
+    {"webp", "image/webp"},
+    {"wgsl", "text/wgsl"},
+    {"wgt", "application/widget"},
+    {"wif", "application/watcherinfo+xml"},
+    {"wks", "application/vnd.ms-works"},
+    {"wlnk", "application/link-format"},
+    {"wm", "video/x-ms-wm"},
+    {"wma", "audio/x-ms-wma"},
+    {"wmf", "image/wmf"},
+    {"wmv", "video/x-ms-wmv"},
+    {"wmx", "video/x-ms-wmx"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"wpl", "application/vnd.ms-wpl"},
+    {"wps", "application/vnd.ms-works"},
+    {"wsdl", "application/wsdl+xml"},
+    {"wspolicy", "application/wspolicy+xml"},
+    {"wvx", "video/x-ms-wvx"},
+    {"xav", "application/xcap-att+xml"},
+    {"xbm", "image/x-xbitmap"},
+    {"xca", "application/xcap-caps+xml"},
+    {"xcf", "image/x-xcf"},
+    {"xcs", "application/calendar+xml"},
+    {"xdd", "application/bacnet-xdd+zip"},
+    {"xdf", "application/xcap-diff+xml"},
+    {"xdp", "application/vnd.adobe.xdp+xml"},
+    {"xdssc", "application/dssc+xml"},
+    {"xel", "application/xcap-el+xml"},
+    {"xer", "application/xcap-error+xml"},
+    {"xfdf", "application/xfdf"},
+    {"xhe", "audio/usac"},
+    {"xht", "application/xhtml+xml"},
+    {"xhtm", "application/xhtml+xml"},
+    {"xhtml", "application/xhtml+xml"},
+    {"xhvml", "application/xv+xml"},
+    {"xla", "application/vnd.ms-excel"},
+    {"xlam", "application/vnd.ms-excel.addin.macroEnabled.12"},
+    {"xlc", "application/vnd.ms-excel"},
+    {"xlf", "application/xliff+xml"},
+    {"xlm", "application/vnd.ms-excel"},
+    {"xls", "application/vnd.ms-excel"},
+    {"xlsb", "application/vnd.ms-excel.sheet.binary.macroEnabled.12"},
+    {"xlsm", "application/vnd.ms-excel.sheet.macroEnabled.12"},
+    {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+    {"xlt", "application/vnd.ms-excel"},
+    {"xltm", "application/vnd.ms-excel.template.macroEnabled.12"},
+    {"xltx", "application/vnd.openxmlformats-officedocument.spreadsheetml.template"},
+    {"xlw", "application/vnd.ms-excel"},
+    {"xml", "application/xml"},
+    {"xmls", "application/dskpp+xml"},
+    {"xns", "application/xcap-ns+xml"},
+    {"xop", "application/xop+xml"},
+    {"xpi", "application/x-xpinstall"},
+    {"xpm", "image/x-xpixmap"},
+    {"xps", "application/vnd.ms-xpsdocument"},
+    {"xsf", "application/prs.xsf+xml"},
+    {"xsl", "application/xslt+xml"},
+    {"xslt", "application/xslt+xml"},
+    {"xspf", "application/xspf+xml"},
+    {"xul", "application/vnd.mozilla.xul+xml"},
+    {"xvm", "application/xv+xml"},
+    {"xvml", "application/xv+xml"},
+    {"xwd", "image/x-xwindowdump"},
+    {"xz", "application/x-xz"},
+    {"yaml", "application/yaml"},
+    {"yang", "application/yang"},
+    {"yin", "application/yin+xml"},
+    {"yml", "application/yaml"},
+    {"zip", "application/zip"},
+    {"zone", "text/dns"},
+    {"zst", "application/zstd"},
+};
+
+const size_t MIME_COUNT = sizeof(mime_entries) / sizeof(mime_entries[0]);
+
+static constexpr std::array<std::string_view, MIME_COUNT> mimeKeys()
+{
+    std::array<std::string_view, MIME_COUNT> keys{};
+    for (size_t i = 0; i < MIME_COUNT; ++i)
+        keys[i] = mime_entries[i].ext;
+    return keys;
+}
+
+static constexpr auto mime_table = buildPerfectHash<MIME_COUNT / 2, 2048>(mimeKeys());
+static_assert(mime_table.ok, "MIME table has a duplicate extension");
+
+std::string_view MimeType::getMime(std::string_view file_name)
+{
+    size_t dot = file_name.find_last_of("./");
+    if (dot == std::string_view::npos || file_name[dot] != '.')
+        return MIME_DEFAULT;
+    std::string_view ext = file_name.substr(dot + 1);
+    int i = mime_table.find(ext);
+    if (i < 0 || !phEqualsIgnoreCase(ext, mime_entries[i].ext))
+        return MIME_DEFAULT;
+    return mime_entries[i].type;
+}
+
+// 文本类的内容压缩效果好；jpg、png、mp3、gz这些本身就是压缩过的，再压也小不了
+bool MimeType::compressible(std::string_view type)
+{
+    if (type.compare(0, 5, "text/") == 0)
+        return true;
+    if (type.size() > 4 && (type.compare(type.size() - 4, 4, "+xml") == 0 || type.compare(type.size() - 5, 5, "+json") == 0))
+        return true;
+    return type == "application/javascript" || type == "application/json" || type == "application/xml"
+        || type == "application/wasm" || type == "application/yaml" || type == "image/bmp" || type == "image/x-icon";
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string_view>
+
+const std::string_view MIME_DEFAULT = "text/html";     // 没有扩展名或者扩展名不认识时的类型
+
+/* 文件扩展名到MIME类型的映射。几百个扩展名的表在编译期建成完美哈希(见perfectHash.h)，放在只读数据段，
+   查找不加锁、不分配内存，返回的string_view指向静态存储，一直有效 */
+class MimeType
+{
+public:
+    static std::string_view getMime(std::string_view file_name);  // 按文件名最后一段的扩展名查，不区分大小写
+    static bool compressible(std::string_view type);              // 这种类型的内容值得gzip压缩
+
+private:
+    MimeType();     // 只有静态方法，禁止实例化
+};
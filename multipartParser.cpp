@@ -0,0 +1,347 @@
+#include "multipartParser.h"
+#include "httpParser.h"
+#include "httpHeaders.h"
+#include <immintrin.h>
+#include <string.h>
+
+static const size_t NPOS = std::string::npos;
+
+// 在buf里找needle(长度m，至少3个字节)第一次出现的位置，没有返回NPOS
+static size_t findDelimScalar(const char *buf, size_t len, const char *needle, size_t m)
+{
+    if (len < m)
+        return NPOS;
+    const char *p = buf;
+    const char *end = buf + len - m + 1; // 匹配的起点只能在end之前
+    while (p < end && (p = static_cast<const char*>(memchr(p, needle[0], end - p))) != NULL)
+    {
+        if (memcmp(p + 1, needle + 1, m - 1) == 0)
+            return p - buf;
+        ++p;
+    }
+    return NPOS;
+}
+
+// 一次看16个起点：起点处的字节等于needle首字节、起点+m-1处的字节等于needle末字节的才逐字节比较中间部分
+__attribute__((target("sse2")))
+static size_t findDelimSse2(const char *buf, size_t len, const char *needle, size_t m)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                        _mm_cmpeq_epi8(block_last, last)));
+        while (mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(buf + i + bit + 1, needle + 1, m - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = findDelimScalar(buf + i, len - i, needle, m);
+    return rest == NPOS ? NPOS : i + rest;
+}
+
+// 同上，一次看32个起点
+__attribute__((target("avx2")))
+static size_t findDelimAvx2(const char *buf, size_t len, const char *needle, size_t m)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i));
+        __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + m - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                              _mm256_cmpeq_epi8(block_last, last)));
+        while (mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(buf + i + bit + 1, needle + 1, m - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = findDelimSse2(buf + i, len - i, needle, m);
+    return rest == NPOS ? NPOS : i + rest;
+}
+
+// 和请求解析器用同一档实现，压测时setParserImpl一起切换
+static size_t findDelim(const char *buf, size_t len, const std::string &needle)
+{
+    switch (parserImpl())
+    {
+        case PARSER_AVX2:
+            return findDelimAvx2(buf, len, needle.data(), needle.size());
+        case PARSER_SSE42:
+            return findDelimSse2(buf, len, needle.data(), needle.size());
+        default:
+            return findDelimScalar(buf, len, needle.data(), needle.size());
+    }
+}
+
+static std::string_view trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// 取出形如 type; key=value; key="quoted value" 的头部值里key参数的值，key不区分大小写
+static bool headerParam(std::string_view value, std::string_view key, std::string &out)
+{
+    size_t pos = value.find(';');
+    while (pos != NPOS)
+    {
+        ++pos;
+        size_t eq = value.find('=', pos);
+        if (eq == NPOS)
+            return false;
+        std::string_view k = trim(value.substr(pos, eq - pos));
+        pos = eq + 1;
+        while (pos < value.size() && (value[pos] == ' ' || value[pos] == '\t'))
+            ++pos;
+        std::string v;
+        if (pos < value.size() && value[pos] == '"')
+        {
+            for (++pos; pos < value.size() && value[pos] != '"'; ++pos)
+            {
+                if (value[pos] == '\\' && pos + 1 < value.size())
+                    ++pos;
+                v += value[pos];
+            }
+            pos = value.find(';', pos);
+        }
+        else
+        {
+            size_t end = value.find(';', pos);
+            std::string_view token = trim(value.substr(pos, end == NPOS ? NPOS : end - pos));
+            v.assign(token.data(), token.size());
+            pos = end;
+        }
+        if (equalsIgnoreCase(k, key))
+        {
+            out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool multipartBoundary(std::string_view content_type, std::string &boundary)
+{
+    std::string_view type = trim(content_type.substr(0, content_type.find(';')));
+    if (!equalsIgnoreCase(type, "multipart/form-data"))
+        return false;
+    boundary.clear();
+    headerParam(content_type, "boundary", boundary);
+    return true;
+}
+
+MultipartParser::MultipartParser():
+    state(MP_DONE),
+    handler(NULL)
+{
+}
+
+int MultipartParser::reset(std::string_view boundary, MultipartHandler *_handler)
+{
+    if (boundary.empty() || boundary.size() > MAX_BOUNDARY_LEN)
+        return -1;
+    delim = "\r\n--";
+    delim.append(boundary.data(), boundary.size());
+    // 第一个分隔符前面没有CRLF，当作请求体前面多了一个CRLF，和后面的分隔符统一处理
+    carry = "\r\n";
+    state = MP_PREAMBLE;
+    handler = _handler;
+    return 0;
+}
+
+int MultipartParser::emit(const char *data, size_t len)
+{
+    if (state == MP_DATA && len > 0)
+        return handler->onPartData(data, len);
+    return 0;
+}
+
+int MultipartParser::foundDelim()
+{
+    int ret = 0;
+    if (state == MP_DATA)
+        ret = handler->onPartEnd();
+    state = MP_BOUNDARY_TAIL;
+    return ret;
+}
+
+size_t MultipartParser::partialDelim(const char *buf, size_t len) const
+{
+    size_t k = len < delim.size() - 1 ? len : delim.size() - 1;
+    for (; k > 0; --k)
+    {
+        if (buf[len - k] == '\r' && memcmp(buf + len - k, delim.data(), k) == 0)
+            return k;
+    }
+    return 0;
+}
+
+/* carry里是上次结尾的半截分隔符(不到一个分隔符长)。把新数据的前m-1个字节接上去找：
+   从carry里开始的分隔符一定完整地落在这一小段里，找不到就说明carry里的字节都是正文 */
+int MultipartParser::feedCarry(const char *&buf, size_t &len)
+{
+    size_t old = carry.size();
+    size_t extra = len < delim.size() - 1 ? len : delim.size() - 1;
+    carry.append(buf, extra);
+    size_t pos = findDelim(carry.data(), carry.size(), delim);
+    if (pos != NPOS && pos < old)
+    {
+        int ret = emit(carry.data(), pos);
+        size_t used = pos + delim.size() - old;
+        carry.clear();
+        buf += used;
+        len -= used;
+        return ret < 0 ? ret : foundDelim();
+    }
+    if (pos == NPOS && extra == len) // 新数据太短，整个接进carry，结尾可能还是半截分隔符
+    {
+        size_t keep = partialDelim(carry.data(), carry.size());
+        int ret = emit(carry.data(), carry.size() - keep);
+        carry.erase(0, carry.size() - keep);
+        buf += len;
+        len = 0;
+        return ret;
+    }
+    int ret = emit(carry.data(), old);
+    carry.clear();
+    return ret;
+}
+
+int MultipartParser::feed(const char *buf, size_t len)
+{
+    int ret = 0;
+    while (len > 0 && state != MP_DONE)
+    {
+        switch (state)
+        {
+        case MP_PREAMBLE:
+        case MP_DATA:
+        {
+            if (!carry.empty())
+            {
+                if ((ret = feedCarry(buf, len)) < 0)
+                    return ret;
+                continue;
+            }
+            size_t pos = findDelim(buf, len, delim);
+            if (pos != NPOS)
+            {
+                if ((ret = emit(buf, pos)) < 0)
+                    return ret;
+                buf += pos + delim.size();
+                len -= pos + delim.size();
+                if ((ret = foundDelim()) < 0)
+                    return ret;
+                continue;
+            }
+            // 没有完整的分隔符，结尾可能是下一个分隔符的开头，留到下次
+            size_t keep = partialDelim(buf, len);
+            if ((ret = emit(buf, len - keep)) < 0)
+                return ret;
+            carry.assign(buf + len - keep, keep);
+            return 0;
+        }
+        case MP_BOUNDARY_TAIL:
+            if (*buf == '-')
+                state = MP_BOUNDARY_DASH;
+            else if (*buf == '\r')
+                state = MP_BOUNDARY_LF;
+            else if (*buf != ' ' && *buf != '\t') // 分隔符后面允许有空白
+                return MULTIPART_ERROR;
+            break;
+        case MP_BOUNDARY_DASH:
+            if (*buf != '-')
+                return MULTIPART_ERROR;
+            state = MP_DONE;
+            break;
+        case MP_BOUNDARY_LF:
+            if (*buf != '\n')
+                return MULTIPART_ERROR;
+            state = MP_HEADERS;
+            carry.clear();
+            break;
+        case MP_HEADERS:
+        {
+            // part头部攒在carry里，从上次结尾往前3个字节接着找空行
+            size_t old = carry.size();
+            size_t take = len < MAX_PART_HEADER_BYTES - old ? len : MAX_PART_HEADER_BYTES - old;
+            carry.append(buf, take);
+            size_t header_len;
+            if (carry.size() >= 2 && carry[0] == '\r' && carry[1] == '\n') // 没有头部
+                header_len = 2;
+            else
+            {
+                size_t end = carry.find("\r\n\r\n", old > 3 ? old - 3 : 0);
+                if (end == NPOS)
+                {
+                    if (carry.size() >= MAX_PART_HEADER_BYTES)
+                        return MULTIPART_ERROR;
+                    return 0;
+                }
+                header_len = end + 4;
+            }
+            size_t used = header_len - old;
+            if ((ret = parseHeaders(std::string_view(carry.data(), header_len - 2))) < 0)
+                return ret;
+            carry.clear();
+            state = MP_DATA;
+            buf += used;
+            len -= used;
+            continue;
+        }
+        default:
+            return MULTIPART_ERROR;
+        }
+        ++buf;
+        --len;
+    }
+    return 0;
+}
+
+// block是一行行以CRLF结尾的part头部
+int MultipartParser::parseHeaders(std::string_view block)
+{
+    MultipartPart part;
+    bool disposition = false;
+    while (!block.empty())
+    {
+        size_t eol = block.find("\r\n");
+        std::string_view line = block.substr(0, eol);
+        block.remove_prefix(eol == NPOS ? block.size() : eol + 2);
+        size_t colon = line.find(':');
+        if (colon == NPOS || colon == 0)
+            return MULTIPART_ERROR;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+        if (equalsIgnoreCase(name, "Content-Disposition"))
+        {
+            std::string_view type = trim(value.substr(0, value.find(';')));
+            if (!equalsIgnoreCase(type, "form-data"))
+                return MULTIPART_ERROR;
+            disposition = true;
+            headerParam(value, "name", part.name);
+            headerParam(value, "filename", part.filename);
+        }
+        else if (equalsIgnoreCase(name, "Content-Type"))
+            part.content_type.assign(value.data(), value.size());
+    }
+    if (!disposition) // form-data的每个part都必须有Content-Disposition
+        return MULTIPART_ERROR;
+    return handler->onPartBegin(part);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <stddef.h>
+
+const size_t MAX_BOUNDARY_LEN = 70;         // RFC 2046规定boundary最长70个字符
+const size_t MAX_PART_HEADER_BYTES = 8192;  // 一个part的头部最多这么多字节
+const int MULTIPART_ERROR = -1;             // 格式错误
+
+// 一个part的头部里处理函数关心的信息
+struct MultipartPart
+{
+    std::string name;           // Content-Disposition里的name
+    std::string filename;       // Content-Disposition里的filename，不是文件时为空
+    std::string content_type;   // 没有Content-Type时为空
+};
+
+// 接收multipart各个part的处理函数，返回负数时停止解析
+class MultipartHandler
+{
+public:
+    virtual ~MultipartHandler() {}
+    virtual int onPartBegin(const MultipartPart &part) = 0;
+    virtual int onPartData(const char *data, size_t len) = 0;   // 一段part正文，可能分很多次交出
+    virtual int onPartEnd() = 0;
+};
+
+/* multipart/form-data 请求体的流式解析器。请求体一段段到达时边找分隔符边把正文交给处理函数，
+   不需要先把整个请求体存下来；正文是feed()传入数据的视图，只有落在两次feed之间的半截分隔符
+   和part头部才先存在carry里，最多也就是一个分隔符或者MAX_PART_HEADER_BYTES那么长。
+   找分隔符用SIMD一次比较分隔符的首尾两个字节，按httpParser选定的实现在AVX2、SSE2和逐字节之间切换 */
+class MultipartParser
+{
+private:
+    enum State
+    {
+        MP_PREAMBLE,        // 第一个分隔符之前，内容丢弃
+        MP_BOUNDARY_TAIL,   // 分隔符之后，接下来是CRLF(下一个part)或者--(结束)
+        MP_BOUNDARY_DASH,   // 结束标记的第二个-
+        MP_BOUNDARY_LF,     // 分隔符行结尾的LF
+        MP_HEADERS,         // part的头部
+        MP_DATA,            // part的正文
+        MP_DONE             // 结束分隔符之后的内容丢弃
+    };
+    State state;
+    std::string delim;      // "\r\n--" + boundary
+    std::string carry;      // 跨两次feed的半截分隔符或者还没收全的part头部
+    MultipartHandler *handler;
+
+    int emit(const char *data, size_t len);     // PREAMBLE里丢弃，DATA里交给处理函数
+    int foundDelim();                           // 找到了一个完整的分隔符
+    int parseHeaders(std::string_view block);   // 解析part头部并通知处理函数
+    size_t partialDelim(const char *buf, size_t len) const; // buf结尾可能是分隔符开头的最长长度
+    int feedCarry(const char *&buf, size_t &len); // carry里有半截分隔符时先把它和新数据接起来处理
+
+public:
+    MultipartParser();
+    // boundary不合法返回-1
+    int reset(std::string_view boundary, MultipartHandler *_handler);
+    // 交给解析器一段请求体，格式错误返回MULTIPART_ERROR，处理函数出错时返回它的返回值
+    int feed(const char *buf, size_t len);
+    bool done() const { return state == MP_DONE; }
+};
+
+// 从Content-Type里取出multipart/form-data的boundary，不是multipart/form-data返回false，没有boundary参数时boundary为空
+bool multipartBoundary(std::string_view content_type, std::string &boundary);
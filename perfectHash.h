@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+#include <stddef.h>
+#include <stdint.h>
+
+/* 编译期生成的最小冲突哈希表(hash-and-displace)。
+   键先哈希一次，按哈希值分进B个桶，再从大桶到小桶依次给每个桶找一个种子，让桶里的键的哈希值和种子混合后落到互不相同的空槽；
+   查找时逐字节的哈希只算一次，混合种子只是几次乘法移位，最后比一次字符串，不加锁、不分配内存，也没有冲突链。
+   表在constexpr里建好，整个放在只读数据段，键有重复或者种子试完了都找不到时ok为false，由static_assert在编译时报出来 */
+
+constexpr unsigned char phLower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c | 0x20) : (unsigned char)c;
+}
+
+// 转小写后的FNV-1a；大小写不同的键哈希一样，比较时再决定区不区分
+constexpr uint32_t phHash(std::string_view key)
+{
+    uint32_t h = 2166136261u;
+    for (char c : key)
+        h = (h ^ phLower(c)) * 16777619u;
+    return h;
+}
+
+// 键的哈希和桶的种子混合成槽号，种子不同结果互相独立
+constexpr uint32_t phMix(uint32_t h, uint32_t seed)
+{
+    h ^= seed * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+constexpr bool phEqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (phLower(a[i]) != phLower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+// N个键，B个桶，M个槽(2的幂，取键数的两倍左右)
+template <size_t N, size_t B, size_t M>
+struct PerfectHash
+{
+    static_assert((M & (M - 1)) == 0, "slot count must be a power of two");
+    std::array<uint16_t, B> seeds;  // 每个桶的种子
+    std::array<int16_t, M> slots;   // 槽里是键的下标，-1为空
+    bool ok;
+
+    // 返回key可能在的那个键的下标，调用者还要比较字符串；槽是空的返回-1
+    constexpr int find(std::string_view key) const
+    {
+        uint32_t h = phHash(key);
+        return slots[phMix(h, seeds[h % B]) & (M - 1)];
+    }
+};
+
+template <size_t B, size_t M, size_t N>
+constexpr PerfectHash<N, B, M> buildPerfectHash(const std::array<std::string_view, N> &keys)
+{
+    PerfectHash<N, B, M> table{};
+    table.ok = true;
+    for (size_t i = 0; i < M; ++i)
+        table.slots[i] = -1;
+    std::array<uint32_t, N> hash_of{};
+    std::array<uint32_t, N> bucket_of{};
+    std::array<uint16_t, B> bucket_size{};
+    size_t max_size = 0;
+    for (size_t i = 0; i < N; ++i)
+    {
+        hash_of[i] = phHash(keys[i]);
+        bucket_of[i] = hash_of[i] % B;
+        if (++bucket_size[bucket_of[i]] > max_size)
+            max_size = bucket_size[bucket_of[i]];
+    }
+    // 大桶先放，空槽多的时候容易找到种子
+    for (size_t size = max_size; size > 0; --size)
+    {
+        for (size_t b = 0; b < B; ++b)
+        {
+            if (bucket_size[b] != size)
+                continue;
+            bool placed = false;
+            for (uint32_t seed = 0; seed < 65535; ++seed)
+            {
+                placed = true;
+                for (size_t i = 0; i < N && placed; ++i)
+                {
+                    if (bucket_of[i] != b)
+                        continue;
+                    uint32_t slot = phMix(hash_of[i], seed) & (M - 1);
+                    if (table.slots[slot] >= 0)
+                        placed = false;
+                    else
+                        table.slots[slot] = (int16_t)i;
+                }
+                if (placed)
+                {
+                    table.seeds[b] = (uint16_t)seed;
+                    break;
+                }
+                // 撞上了，把这次放进去的撤掉换下一个种子
+                for (size_t i = 0; i < N; ++i)
+                {
+                    if (bucket_of[i] != b)
+                        continue;
+                    uint32_t slot = phMix(hash_of[i], seed) & (M - 1);
+                    if (table.slots[slot] == (int16_t)i)
+                        table.slots[slot] = -1;
+                }
+            }
+            if (!placed)
+                table.ok = false;
+        }
+    }
+    return table;
+}
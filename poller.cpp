@@ -0,0 +1,13 @@
+#include "poller.h"
+#include "epollPoller.h"
+#include "uringPoller.h"
+
+FileSendMode Poller::file_mode = FILE_SEND_SENDFILE;
+
+// 按名字创建轮询器后端，未知名字按epoll处理
+Poller *Poller::newPoller(const std::string &backend)
+{
+    if (backend == "uring")
+        return new UringPoller();
+    return new EpollPoller();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+
+// 待发送的一段响应数据，owner负责数据的生命周期（堆上的字符串、mmap映射、打开的文件等），发送完成前不能释放
+struct OutChunk
+{
+    const char *data;   // 内存数据，为NULL时表示从file_fd的file_off处发送len字节
+    size_t len;
+    std::shared_ptr<void> owner;
+    int file_fd;
+    off_t file_off;
+    OutChunk(): data(NULL), len(0), file_fd(-1), file_off(0) {}
+};
+
+// 静态文件正文的发送方式
+enum FileSendMode
+{
+    FILE_SEND_MMAP = 0, // mmap整个文件再写，数据要经过用户态拷贝进socket
+    FILE_SEND_SENDFILE, // sendfile直接从页缓存发送
+    FILE_SEND_SPLICE    // splice经由管道从页缓存搬到socket
+};
+
+// 轮询器返回给事件循环的一个事件
+struct PollEvent
+{
+    uint64_t token;     // 上树时登记的fd+gen
+    __uint32_t events;  // EPOLLIN/EPOLLERR/EPOLLHUP等
+    int accept_fd;      // io_uring多发accept直接带回的新连接，没有则为-1
+    const char *data;   // io_uring provided buffer recv直接带回的数据，没有则为NULL
+    int len;
+    int buf_id;         // data所在的provided buffer编号，处理完要release归还
+};
+
+/* 轮询器接口，事件循环(Epoll)通过它完成上树、下树、等待事件和发送数据。
+   epoll后端是就绪通知模型，收发仍由连接自己read/write；
+   io_uring后端是完成通知模型，accept、recv、send、close都提交到ring里，由内核完成后再通知 */
+class Poller
+{
+protected:
+    PollEvent *events;
+    int max_events;
+
+public:
+    Poller(): events(NULL), max_events(0) {}
+    virtual ~Poller() { delete[] events; }
+
+    virtual int init(int maxevents, int listen_num) = 0;
+    virtual int add(int fd, uint64_t token, __uint32_t events) = 0;      // 一般fd(eventfd等)的就绪监听
+    virtual int addConn(int fd, uint64_t token, __uint32_t events) { return add(fd, token, events); } // 连接fd
+    virtual int addListener(int fd, uint64_t token) = 0;                 // 监听fd
+    virtual int mod(int fd, uint64_t token, __uint32_t events) = 0;
+    virtual int del(int fd, uint64_t token) = 0;
+    virtual int poll(int timeout) = 0;                                   // 等待事件，返回事件数
+    virtual void release(const PollEvent &ev) {}                         // 事件处理完，归还其中的接收缓冲区
+    // 发送chunks并从队列里去掉已交出的部分：全部交出返回0，socket写满还有剩余返回1(剩余留在chunks里，等可写再发)，出错返回-1
+    virtual int send(int fd, uint64_t token, std::deque<OutChunk> &chunks) = 0;
+    virtual void close(int fd) = 0;                                      // 关闭连接fd
+    virtual bool ownsIO() const { return false; }                        // true表示收发都经由轮询器完成，连接不能自己read/write
+    const PollEvent &event(int i) const { return events[i]; }
+
+    static Poller *newPoller(const std::string &backend); // 按名字创建后端："epoll"或"uring"
+    static FileSendMode file_mode;                        // 启动时设置一次，之后只读
+};
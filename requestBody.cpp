@@ -0,0 +1,165 @@
+#include "requestBody.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+size_t RequestBody::spill_threshold = BODY_SPILL_DEFAULT;
+size_t RequestBody::mem_limit = BODY_MEM_LIMIT_DEFAULT;
+std::string RequestBody::tmp_dir = "/tmp";
+std::atomic<size_t> RequestBody::mem_in_use(0);
+
+// 写满len字节，被信号打断就接着写
+static int writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 在dir下建一个匿名临时文件，文件系统不支持O_TMPFILE时退回mkstemp再马上unlink
+static int openTmpFile(const std::string &dir)
+{
+    int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL))
+        return fd;
+    std::string path = dir + "/body.XXXXXX";
+    fd = mkostemp(&path[0], O_CLOEXEC);
+    if (fd >= 0)
+        unlink(path.c_str());
+    return fd;
+}
+
+RequestBody::RequestBody():
+    charged(0),
+    file_fd(-1),
+    file_size(0),
+    map(NULL),
+    map_len(0)
+{
+}
+
+RequestBody::~RequestBody()
+{
+    clear();
+}
+
+void RequestBody::charge(size_t bytes)
+{
+    if (bytes > charged)
+        mem_in_use += bytes - charged;
+    else
+        mem_in_use -= charged - bytes;
+    charged = bytes;
+}
+
+int RequestBody::spill()
+{
+    file_fd = openTmpFile(tmp_dir);
+    if (file_fd < 0)
+    {
+        perror("open body tmpfile failed");
+        return -1;
+    }
+    file_size = mem.size();
+    if (writeAll(file_fd, mem.data(), mem.size()) < 0)
+    {
+        perror("write body tmpfile failed");
+        return -1;
+    }
+    std::string().swap(mem); // 内存里的这份不要了，真正归还
+    charge(0);
+    return 0;
+}
+
+int RequestBody::reserve(size_t expected)
+{
+    if (file_fd >= 0)
+        return 0;
+    if (expected > spill_threshold || mem_in_use + expected > mem_limit)
+        return spill();
+    mem.reserve(expected);
+    charge(mem.capacity());
+    return 0;
+}
+
+int RequestBody::append(const char *data, size_t len)
+{
+    if (file_fd < 0 && (mem.size() + len > spill_threshold || mem_in_use + len > mem_limit))
+    {
+        if (spill() < 0)
+            return -1;
+    }
+    if (file_fd >= 0)
+    {
+        if (writeAll(file_fd, data, len) < 0)
+        {
+            perror("write body tmpfile failed");
+            return -1;
+        }
+        file_size += len;
+        return 0;
+    }
+    mem.append(data, len);
+    charge(mem.capacity());
+    return 0;
+}
+
+const char *RequestBody::data()
+{
+    if (file_fd < 0)
+        return mem.data();
+    if (file_size == 0) // 空文件不能映射
+        return "";
+    if (map == NULL || map_len != file_size)
+    {
+        if (map)
+            munmap(map, map_len);
+        void *addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            perror("mmap body failed");
+            map = NULL;
+            map_len = 0;
+            return NULL;
+        }
+        map = static_cast<char*>(addr);
+        map_len = file_size;
+    }
+    return map;
+}
+
+void RequestBody::clear()
+{
+    if (map)
+    {
+        munmap(map, map_len);
+        map = NULL;
+        map_len = 0;
+    }
+    if (file_fd >= 0)
+    {
+        close(file_fd);
+        file_fd = -1;
+        file_size = 0;
+    }
+    if (charged > 0)
+    {
+        std::string().swap(mem);
+        charge(0);
+    }
+    else
+        mem.clear();
+}
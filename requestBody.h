@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <stddef.h>
+
+const size_t BODY_SPILL_DEFAULT = 1 << 20;      // 单个请求体在内存里最多放这么多，再多就转存到临时文件
+const size_t BODY_MEM_LIMIT_DEFAULT = 64 << 20; // 所有连接的请求体加起来最多占这么多内存
+
+/* 一个请求的请求体。小的放在内存里；超过spill_threshold，或者全部连接的请求体内存超过mem_limit时，
+   已经收到的部分连同后续数据都写进O_TMPFILE临时文件，内存占用不随上传大小增长。
+   处理函数拿到的是data()/size()视图：在内存里就是字符串，在文件里就是只读mmap，都不再拷贝一份 */
+class RequestBody
+{
+private:
+    std::string mem;    // 还在内存里时的数据
+    size_t charged;     // 已经计入mem_in_use的字节数，就是mem的容量
+    int file_fd;        // 转存后的临时文件，-1表示还在内存里
+    size_t file_size;
+    char *map;          // data()时对临时文件建立的映射
+    size_t map_len;
+
+    int spill();                // 把内存里的数据转存到临时文件
+    void charge(size_t bytes);  // 把计入全局统计的字节数调整为bytes
+
+public:
+    static size_t spill_threshold;              // 启动时设置一次，之后只读
+    static size_t mem_limit;
+    static std::string tmp_dir;                 // 临时文件所在目录
+    static std::atomic<size_t> mem_in_use;      // 所有连接的请求体当前占用的内存
+
+    RequestBody();
+    ~RequestBody();
+    int reserve(size_t expected);               // 预先知道请求体长度(Content-length)时调用，太大直接写文件
+    int append(const char *data, size_t len);   // 追加一段请求体，写临时文件出错返回-1
+    const char *data();                         // 整个请求体的连续视图，长度为size()，出错返回NULL
+    size_t size() const { return file_fd >= 0 ? file_size : mem.size(); }
+    bool empty() const { return size() == 0; }
+    bool onDisk() const { return file_fd >= 0; }
+    int fd() const { return file_fd; }          // 临时文件，还在内存里时为-1
+    void clear();                               // 丢掉请求体，关闭临时文件并归还内存
+
+private:
+    RequestBody(const RequestBody &);
+    RequestBody &operator=(const RequestBody &);
+};
@@ -2,15 +2,22 @@
 #include "util.h"
 #include "epoll.h"
 #include "log.h"
+#include "httpParser.h"
+#include "multipartParser.h"
+#include "http2.h"
+#include "fileCache.h"
+#include "responseBuilder.h"
+#include "mimeType.h"
 #include <sys/epoll.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <unordered_map>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <queue>
 #include <cstdlib>
+#include <string.h>
+#include <climits>
 //#include <opencv/cv.h> 已弃用
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core/core.hpp>
@@ -22,64 +29,54 @@ using namespace cv;
 #include <iostream>
 using namespace std;
 
-pthread_mutex_t MutexLockGuard::lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t MimeType::lock = PTHREAD_MUTEX_INITIALIZER;
-std::unordered_map<std::string, std::string> MimeType::mime;
-
-// 接收一个字符串，返回一个文件类型
-std::string MimeType::getMime(const std::string &suffix)
-{
-    if (mime.size() == 0) // 懒汉式双重检查锁
-    {
-        pthread_mutex_lock(&lock);
-        if (mime.size() == 0)
-        {
-            mime[".html"] = "text/html";
-            mime[".avi"] = "video/x-msvideo";
-            mime[".bmp"] = "image/bmp";
-            mime[".c"] = "text/plain";
-            mime[".doc"] = "application/msword";
-            mime[".gif"] = "image/gif";
-            mime[".gz"] = "application/x-gzip";
-            mime[".htm"] = "text/html";
-            mime[".ico"] = "application/x-ico";
-            mime[".jpg"] = "image/jpeg";
-            mime[".png"] = "image/png";
-            mime[".txt"] = "text/plain";
-            mime[".mp3"] = "audio/mp3";
-            mime["default"] = "text/html";
-        }
-        pthread_mutex_unlock(&lock);
-    }
-    if (mime.find(suffix) == mime.end()) // 没找到对应的文件类型
-        return mime["default"];
-    else
-        return mime[suffix];
-}
+std::string requestData::upload_dir;
 
-// 定义一个装定时器的优先级队列，数据类型为mytimer的智能指针，用deque实现，顺序规则为timerCmp，小顶堆
-// 属于临界资源，使用时要加锁
-std::priority_queue<shared_ptr<mytimer>, std::deque<shared_ptr<mytimer>>, timerCmp> myTimerQueue;
+// 长连接的两行头部，每个响应都一样，启动时拼一次
+static const std::string KEEP_ALIVE_FIELDS = "Connection: keep-alive\r\nKeep-Alive: timeout="
+    + std::to_string(EPOLL_WAIT_TIME) + "\r\n";
 
 // 请求对象的构造函数，当有事件请求时会自动调用初始化一个实例对象
 requestData::requestData(): 
-    now_read_pos(0), 
+    body_chunked(false), 
+    body_left(0), 
+    body_multipart(false), 
+    part_image(false), 
+    part_fd(-1), 
     state(STATE_PARSE_URI), 
-    h_state(h_start), 
+    header_scanned(0), 
     keep_alive(false), 
-    againTimes(0)
+    againTimes(0),
+    loop(NULL),
+    timer(this),
+    in_data(NULL),
+    in_len(0),
+    writing(false),
+    close_after_write(false),
+    pipelined(false),
+    h2_stream(false)
 {
     cout << "requestData()" << endl;
 }
-requestData::requestData(int _epollfd, int _fd, std::string _path):
-    now_read_pos(0), 
+requestData::requestData(Epoll *_loop, int _fd, std::string _path):
+    body_chunked(false), 
+    body_left(0), 
+    body_multipart(false), 
+    part_image(false), 
+    part_fd(-1), 
     state(STATE_PARSE_URI), 
-    h_state(h_start), 
+    header_scanned(0), 
     keep_alive(false), 
     againTimes(0), 
     path(_path), 
     fd(_fd), 
-    epollfd(_epollfd)
+    loop(_loop),
+    timer(this),
+    in_data(NULL),
+    in_len(0),
+    writing(false),
+    close_after_write(false),
+    pipelined(false),
+    h2_stream(false)
 {
     cout << "requestData()" << endl;
 }
@@ -88,138 +85,197 @@ requestData::requestData(int _epollfd, int _fd, std::string _path):
 requestData::~requestData()
 {
     cout << "~requestData()" << endl;
-    //智能指针接收的对象，自动销毁，关闭fd即可
-    close(fd);
+    abortPart();
+    seperateTimer();
+    //智能指针接收的对象，自动销毁，关闭fd即可；经由所属循环关闭，io_uring下会排在未发完的响应之后
+    if (loop)
+        loop->close_fd(fd);
+    else if (fd >= 0) // HTTP/2的流没有自己的fd
+        close(fd);
 }
 
-void requestData::addTimer(shared_ptr<mytimer> mtimer)
+void requestData::addTimer(int timeout)
 {
-    timer = mtimer;
+    loop->addTimer(&timer, timeout);
 }
 int requestData::getFd()
 {
     return fd;
 }
+Epoll *requestData::getLoop()
+{
+    return loop;
+}
 void requestData::setFd(int _fd)
 {
     fd = _fd;
 }
+void requestData::feedInput(const char *data, int len)
+{
+    in_data = data;
+    in_len = len;
+}
+void requestData::appendOutput(const string &str)
+{
+    shared_ptr<string> copy(new string(str));
+    appendOutput(copy->data(), copy->size(), copy);
+}
+void requestData::appendOutput(const shared_ptr<string> &str)
+{
+    appendOutput(str->data(), str->size(), str);
+}
+void requestData::appendOutput(const char *data, size_t len, shared_ptr<void> owner)
+{
+    OutChunk chunk;
+    chunk.data = data;
+    chunk.len = len;
+    chunk.owner = owner;
+    out_chunks.push_back(chunk);
+}
+void requestData::appendFile(int file_fd, off_t offset, size_t len, shared_ptr<void> owner)
+{
+    OutChunk chunk;
+    chunk.len = len;
+    chunk.owner = owner;
+    chunk.file_fd = file_fd;
+    chunk.file_off = offset;
+    out_chunks.push_back(chunk);
+}
 
 /*将对象内容清空，一般用于长连接对象，本次通信完成不删除只清空，然后重新上树监控，
   但除非在时限内又发送请求且是长连接，否则清空会变成默认的短连接*/
 void requestData::reset()
+{
+    nextRequest();
+    input.clear();
+    h2.reset();
+    path.clear();
+    writing = false;
+    close_after_write = false;
+    seperateTimer(); // 若还挂着定时器也摘下来
+}
+
+// 只清空上一个请求的解析结果，输入缓冲区里已经读进来的后续请求保留
+void requestData::nextRequest()
 {
     againTimes = 0;
-    content.clear();
+    header_scanned = 0;
     file_name.clear();
-    path.clear();
-    now_read_pos = 0;
+    body.clear();
+    body_chunked = false;
+    body_left = 0;
+    chunked.reset();
+    body_multipart = false;
+    abortPart();
     state = STATE_PARSE_URI;
-    h_state = h_start;
     headers.clear();
     keep_alive = false;
-    if (timer.lock()) // 若还绑有定时器也清空解绑
-    {
-        shared_ptr<mytimer> my_timer(timer.lock());
-        my_timer->clearReq();
-        timer.reset();
-    }
 }
 
-// 对象要进任务池了，将定时器分离，不再绑定该对象
+// 对象要进任务池了，把定时器从时间轮上摘下来，处理期间不会超时
 void requestData::seperateTimer()
 {
-    if (auto my_timer = timer.lock()) // 如果mytimer还未被释放，则创建一个指向它的shared_ptr<mytimer>
-    {
-        //shared_ptr<mytimer> my_timer(timer.lock()); // timer是weakptr，要先检查是否存在
-        my_timer->clearReq(); // 清除绑定
-        timer.reset(); // timer置空
-    }
+    if (loop) // HTTP/2的流没有自己的循环，也从不挂定时器
+        loop->delTimer(&timer);
 }
 
 // 请求对象的处理函数
 void requestData::handleRequest()
 {
-
-    char buff[MAX_BUFF];
     bool isError = false;
-    while (true)
+    bool drained = false;   // socket已经读到EAGAIN，或io_uring交来的数据已经取完
+    int handled = 0;        // 本轮已经应答的请求数
+    // 上一轮让出时缓冲区里留着完整的请求，先解析它们再读
+    bool need_read = input.empty() || state != STATE_PARSE_URI || h2;
+    if (!writing) // 等EPOLLOUT期间不读新请求，让出的标记要留到发完
+        pipelined = false;
+    while (!writing) // 上一个响应还没发完(这次是EPOLLOUT触发)时不读新请求，直接去接着发
     {
-        int read_num = readn(fd, buff, MAX_BUFF); //fd为记录在请求对象里的cfd，readn是非阻塞循环读完
-        if (read_num < 0)
+        if (need_read) // 缓冲区里的数据不够一个完整请求，要再读
         {
-            perror("1");
-            isError = true;
-            break;
-        }
-        else if (read_num == 0)
-        {
-            // 有请求出现但是读不到数据，可能是Request Aborted，或者来自网络的数据没有达到等原因
-            perror("read_num == 0");
-            if (errno == EAGAIN)
+            // 等头部时最多攒到能判出431的大小，请求体和HTTP/2帧边读边交出去，只需要小缓冲区
+            size_t read_limit = state == STATE_PARSE_URI && !h2 ? INPUT_BUFF_HEADER_MAX : INPUT_BUFF_BODY_MAX;
+            ssize_t read_num;
+            if (loop->ownsIO()) // io_uring已经把数据收到了provided buffer里，整段拷进输入缓冲区，取完就等下一次完成事件
             {
-                if (againTimes > AGAIN_MAX_TIMES) //如果该对象请求超过200次则放弃该连接，isError记为true
-                    isError = true;
-                else
-                    ++againTimes; //还没到200，先加一次
+                if (in_len <= 0)
+                    break;
+                read_num = in_len;
+                input.append(in_data, in_len);
+                in_len = 0;
             }
-            else if (errno != 0) //是其他不可容忍的错误，直接记错跳出
+            else if ((read_num = input.readFd(fd, read_limit)) < 0) //fd为记录在请求对象里的cfd，直接读进输入缓冲区的空闲空间，读到EAGAIN或读满为止
+            {
+                perror("1");
                 isError = true;
-            break;
-        }
-        string now_read(buff, buff + read_num); //获取当前读到的字符串，将buff到buff + read_num存到nr中
-        content += now_read; //累计到该请求对象的请求内容中
-
-        if (state == STATE_PARSE_URI) //当前状态是解析请求的URI
-        {
-            int flag = this->parse_URI(); //调用对象的解析URI方法
-            if (flag == PARSE_URI_AGAIN) //还要继续解析URI，如一次没读完
+                break;
+            }
+            else if (read_num == 0)
             {
+                // 有请求出现但是读不到数据，可能是Request Aborted，或者来自网络的数据没有达到等原因
+                int err = errno; // perror写stderr时可能改掉errno(比如重定向到文件时的ENOTTY)，先存下来
+                perror("read_num == 0");
+                if (err == EAGAIN)
+                {
+                    if (againTimes > AGAIN_MAX_TIMES) //如果该对象请求超过200次则放弃该连接，isError记为true
+                        isError = true;
+                    else
+                        ++againTimes; //还没到200，先加一次
+                }
+                else if (err != 0) //是其他不可容忍的错误，直接记错跳出
+                    isError = true;
                 break;
             }
-            else if (flag == PARSE_URI_ERROR)
+            againTimes = 0; // 读到了数据就不算空转，慢慢上传的大请求体不会因为等待的次数多被断开
+            drained = loop->ownsIO() || !input.full();
+            // 读满了说明socket里可能还有数据，没到上限就扩容接着读；到了上限先交给下面解析、消费掉，再回来读
+            if (!drained && input.capacity() < read_limit)
+                continue;
+        }
+        need_read = true;
+
+        if (h2) // 已经切换到HTTP/2，缓冲区里是帧，交给会话拆开分给各个流
+        {
+            if (h2->onInput(input, out_chunks) < 0) // 会话出错或者对方GOAWAY了，GOAWAY发完就关
             {
-                perror("2");
                 isError = true;
                 break;
             }
+            if (!drained)
+                continue;
+            break;
         }
-        if (state == STATE_PARSE_HEADERS) //当前状态是解析请求的头部
+        if (state == STATE_PARSE_URI) //当前状态是解析请求行和请求头
         {
-            int flag = this->parse_Headers(); //调用对象的解析头部方法
-            if (flag == PARSE_HEADER_AGAIN) //还要继续解析头部，如一次没读完
-            {  
+            int flag = this->parse_Request(); //调用对象的解析方法，成功后进入接收请求体或分析请求状态
+            if (flag == PARSE_URI_AGAIN) //还要继续解析，如头部一次没读完
+            {
+                if (!drained) //让出后接着处理时还没读过socket，ET模式下要读到EAGAIN为止
+                    continue;
                 break;
             }
-            else if (flag == PARSE_HEADER_ERROR)
+            else if (flag == PARSE_URI_ERROR)
             {
-                perror("3");
+                perror("2");
                 isError = true;
                 break;
             }
-            if (method == METHOD_POST)  // 如果是POST请求还要解析请求体
+            else if (flag == PARSE_URI_H2) // 缓冲区里剩下的(连接前言和帧)马上交给会话
             {
-                state = STATE_RECV_BODY;
-            }
-            else 
-            {
-                state = STATE_ANALYSIS; //反之是GET就直接进入分析请求
+                need_read = input.empty();
+                continue;
             }
         }
-        if (state == STATE_RECV_BODY)  // POST解析请求体
+        if (state == STATE_RECV_BODY)  // POST接收请求体，收到多少交出多少，不等整个请求体到齐
         {
-            int content_length = -1;
-            if (headers.find("Content-length") != headers.end()) //在headers剩余内容中找到请求体的长度信息
-            {
-                content_length = stoi(headers["Content-length"]); //Content-length的值是字符串数字
-            }
-            else //没找到，请求头有问题，因为post请求肯定要有
+            int flag = this->recvBody();
+            if (flag == BODY_AGAIN) //请求体还没收完，接着读
+                continue;
+            else if (flag == BODY_ERROR)
             {
                 isError = true;
                 break;
             }
-            if (content.size() < content_length) //当前剩余内容比发来的请求体长度小，说明还没读完
-                continue;
             state = STATE_ANALYSIS; //进入分析请求状态
         }
         if (state == STATE_ANALYSIS)
@@ -232,9 +288,23 @@ void requestData::handleRequest()
             }
             else if (flag == ANALYSIS_SUCCESS)
             {
-
-                state = STATE_FINISH;
-                break;
+                ++handled;
+                if (!keep_alive) // 短连接应答完就关，后面即使还有请求也不处理了
+                {
+                    state = STATE_FINISH;
+                    break;
+                }
+                // 长连接接着解析缓冲区里的下一个请求，应答都攒在out_chunks里最后一次发出
+                nextRequest();
+                if (handled >= MAX_PIPELINE_REQUESTS)
+                {
+                    pipelined = !input.empty() || !drained;
+                    break;
+                }
+                if (!input.empty())
+                    need_read = false;
+                else if (drained)
+                    break;
             }
             else
             {
@@ -244,35 +314,58 @@ void requestData::handleRequest()
         }
     }
 
-    if (isError) //如果上述过程中被标记出错就直接返回
-    {
-        return;
-    }
-    // 如果没被标记为出错，即成功完成任务或有可容忍的错误，加入epoll继续监控
-    if (state == STATE_FINISH)
+    if (in_len > 0 && !isError) // 让出时io_uring交来的数据还没取完，缓冲区马上要还给内核，先存下来
+        input.append(in_data, in_len);
+    in_data = NULL;
+    in_len = 0;
+    // 出错的连接和短连接都要等响应(包括错误页)发完再关
+    if (isError || (state == STATE_FINISH && !keep_alive))
+        close_after_write = true;
+    // 本轮产生的响应统一发送
+    if (!out_chunks.empty())
     {
-        if (keep_alive) //是长连接就只重置对象，继续保持通信
+        int ret = loop->send_output(fd, out_chunks);
+        if (ret < 0)
         {
-            //printf("ok\n");
-            this->reset(); //清除本次通信的内容
+            perror("Send response failed");
+            loop->epoll_del(fd, 0); //连接表一直持有对象，要显式下树才会释放
+            return;
         }
-        else //短连接直接返回
+        if (ret > 0)
         {
+            // socket发送缓冲区满了，剩下的留在out_chunks里，改为等EPOLLOUT，不占着线程空转
+            writing = true;
+            addTimer(SEND_WAIT_TIME);
+            loop->epoll_mod(fd, loop->sendEvents());
             return;
         }
     }
+    bool was_writing = writing; // EPOLLOUT期间换过监听事件，发完要换回来
+    writing = false;
+    if (close_after_write) //如果上述过程中被标记出错或是短连接，发完就直接返回
+    {
+        loop->epoll_del(fd, 0);
+        return;
+    }
+    // 如果没被标记为出错，即成功完成任务或有可容忍的错误，加入epoll继续监控
+    // 长连接在应答完每个请求时已经重置了解析状态，继续保持通信
+    // 流水线上还有请求没处理：不等新的可读事件(ET下可能不会再来)，让事件循环重新调度一次
+    if (pipelined)
+    {
+        if (loop->isInLoop() && was_writing) // 子reactor里连接一直在树上，先换回可读事件
+            loop->epoll_mod(fd, loop->connEvents());
+        if (loop->deferRequest(shared_from_this()) == 0)
+            return;
+    }
     /* 一定要先加时间信息，否则可能会出现刚加进去，下个in触发来了，然后分离失败后，又加入队列，
     最后超时被删，然后正在线程中进行的任务出错，double free错误。*/
     //cout << "shared_from_this().use_count() ==" << shared_from_this().use_count() << endl;
-    shared_ptr<mytimer> mtimer(new mytimer(shared_from_this(), 500));
-    this->addTimer(mtimer); //更新该对象的定时器
-    {
-        MutexLockGuard lock; //在一个函数体里创建锁对象，这样结束自动销毁
-        myTimerQueue.push(mtimer); //再放进队列里
-    }
+    addTimer(EPOLL_WAIT_TIME); //把对象的定时器重新挂到所属循环的时间轮上，只改链表，不分配
+    // 子reactor没有用EPOLLONESHOT，连接一直在树上，不需要重置
+    if (loop->isInLoop() && !was_writing)
+        return;
     // 重置对象上树
-    __uint32_t _epo_event = EPOLLIN | EPOLLET | EPOLLONESHOT;
-    int ret = Epoll::epoll_mod(fd, shared_from_this(), _epo_event);
+    int ret = loop->epoll_mod(fd, loop->connEvents());
     //cout << "shared_from_this().use_count() ==" << shared_from_this().use_count() << endl;
     if (ret < 0)
     {
@@ -282,215 +375,606 @@ void requestData::handleRequest()
     }
 }
 
-// 解析请求的URI(请求行)
-int requestData::parse_URI()
+/* 解析请求行和请求头。头部收齐之前只从上次停下的header_scanned处接着找结尾的空行，
+   收齐后由parseHttpRequest一次扫描完，整个过程每个字节只看常数次；
+   方法、目标和各个头部都是输入缓冲区里的视图，只有文件名和头部键值对拷出来保存 */
+int requestData::parse_Request()
 {
-    string &str = content; //获取请求对象的请求内容
-    // 读到完整的请求行再开始解析请求
-    int pos = str.find('\r', now_read_pos); //从当前位置开始找到\r，刚开始当前位置为0
-    if (pos < 0)
+    // 请求之间多余的空行直接丢掉
+    const char *data = input.peek();
+    size_t blank = 0;
+    while (blank < input.size() && (data[blank] == '\r' || data[blank] == '\n'))
+        ++blank;
+    if (blank > 0)
     {
-        return PARSE_URI_AGAIN;
+        input.consume(blank);
+        data = input.peek();
+        header_scanned = 0;
     }
-    
-    string request_line = str.substr(0, pos); // 把请求行取出来做解析
-    if (str.size() > pos + 1)
-        str = str.substr(pos + 1); // str去掉请求行，节省空间
-    else 
-        str.clear();
-    // 获取Method
-    pos = request_line.find("GET");
-    if (pos < 0)  // 不是GET请求
+    size_t header_len = findHeaderEnd(data, input.size(), header_scanned);
+    if (header_len == 0)
     {
-        pos = request_line.find("POST");
-        if (pos < 0) //也不是POST请求，说明URI错误
+        header_scanned = input.size();
+        if (header_scanned > MAX_HEADER_BYTES) // 头部太大，不再等了
         {
+            handleError(fd, 431, "Request Header Fields Too Large");
             return PARSE_URI_ERROR;
         }
-        else
+        return PARSE_URI_AGAIN;
+    }
+    if (header_len > MAX_HEADER_BYTES)
+    {
+        handleError(fd, 431, "Request Header Fields Too Large");
+        return PARSE_URI_ERROR;
+    }
+    // HTTP/2 prior knowledge：连接前言的前18个字节正好是一行请求行加一个空行，在这里认出来就把连接交给HTTP/2会话
+    if (header_len == 18 && memcmp(data, H2_PREFACE, header_len) == 0)
+    {
+        h2.reset(new Http2Session(path));
+        h2->start(out_chunks);
+        header_scanned = 0;
+        return PARSE_URI_H2;
+    }
+    HttpRequestView req;
+    int parsed = parseHttpRequest(data, header_len, req);
+    if (parsed < 0) // 结尾的空行已经找到了，再不完整也是格式错误
+        return PARSE_URI_ERROR;
+    if (setRequestLine(req.method, req.target) < 0)
+        return PARSE_URI_ERROR;
+    // 检查 HTTP 版本号
+    if (req.minor_version == 0)
+        HTTPversion = HTTP_10;
+    else if (req.minor_version == 1)
+        HTTPversion = HTTP_11;
+    else
+        return PARSE_URI_ERROR;
+    for (int i = 0; i < req.num_headers; ++i)
+        headers.add(req.headers[i].name, req.headers[i].value);
+    input.consume(parsed); // 请求行和头部都用完了，缓冲区里接下来是请求体或者下一个请求
+    header_scanned = 0;
+    /* Upgrade: h2c。只升级没有请求体的GET，这个请求成为HTTP/2的流1，由会话应答；
+       HTTP2-Settings不合法时会话什么都不发，当作普通的HTTP/1.1请求处理 */
+    const string *settings = headers.get(HDR_HTTP2_SETTINGS);
+    if (method == METHOD_GET && HTTPversion == HTTP_11 && settings != NULL && hasToken(HDR_UPGRADE, "h2c"))
+    {
+        vector<HpackHeader> fields;
+        fields.push_back(HpackHeader{":method", string(req.method)});
+        fields.push_back(HpackHeader{":path", string(req.target)});
+        for (int i = 0; i < req.num_headers; ++i)
+            fields.push_back(HpackHeader{string(req.headers[i].name), string(req.headers[i].value)});
+        unique_ptr<Http2Session> session(new Http2Session(path));
+        if (session->upgrade(*settings, fields, out_chunks) == 0)
         {
-            method = METHOD_POST;
+            LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Upgrade to h2c: "<<file_name;
+            h2 = std::move(session);
+            nextRequest();
+            return PARSE_URI_H2;
         }
     }
-    else
+    // 解析请求日志
+    LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Processing request: "<<file_name;
+    if (method == METHOD_POST)  // 如果是POST请求还要解析请求体
     {
+        if (prepareBody() < 0)
+            return PARSE_URI_ERROR;
+        state = STATE_RECV_BODY;
+    }
+    else
+        state = STATE_ANALYSIS; //反之是GET就直接进入分析请求
+    return PARSE_URI_SUCCESS;
+}
+
+/* 请求行里的方法和目标换成method和file_name，目标去掉开头的/和后面的查询参数；
+   HTTP/2的:method和:path伪头部也走这里 */
+int requestData::setRequestLine(std::string_view method_name, std::string_view target)
+{
+    // 获取Method，认识但不支持的方法回501，不认识的说明请求行本身不对
+    MethodId id = lookupMethod(method_name);
+    if (id == MTH_GET)
         method = METHOD_GET;
+    else if (id == MTH_POST)
+        method = METHOD_POST;
+    else
+    {
+        if (id != MTH_UNKNOWN)
+            handleError(fd, 501, "Not Implemented");
+        return PARSE_URI_ERROR;
     }
-    //printf("method = %d\n", method);
     // filename
-    pos = request_line.find("/", pos);
-    if (pos < 0)  // 没找到/，URI错误
+    if (target.empty() || target[0] != '/')
+        return PARSE_URI_ERROR;
+    std::string_view name = target.substr(1);
+    size_t query = name.find('?');
+    if (query != std::string_view::npos)
+        name = name.substr(0, query);
+    if (name.empty()) // 没输入请求的文件名，返回一个预设的页面
+        file_name = "index.html";
+    else if (!canonicalPath(name)) // 带..、.或空段(//etc/passwd)的路径可能跑到网站目录外面，也进不了文件缓存，直接拒绝
     {
+        handleError(fd, 400, "Bad Request");
         return PARSE_URI_ERROR;
     }
     else
+        file_name.assign(name.data(), name.size());
+    return PARSE_URI_SUCCESS;
+}
+
+// Connection、Upgrade这些头部是逗号分隔的选项列表，逐个比较，不区分大小写
+bool requestData::hasToken(HeaderId id, std::string_view token) const
+{
+    const string *value = headers.get(id);
+    if (value == NULL)
+        return false;
+    size_t pos = 0;
+    while (pos <= value->size())
     {
-        int _pos = request_line.find(' ', pos); //从当前位置开始找空格，是URI格式文件名的结尾
-        if (_pos < 0)
-            return PARSE_URI_ERROR;
-        else
+        size_t end = value->find(',', pos);
+        if (end == string::npos)
+            end = value->size();
+        std::string_view item(value->data() + pos, end - pos);
+        while (!item.empty() && item.front() == ' ')
+            item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ')
+            item.remove_suffix(1);
+        if (equalsIgnoreCase(item, token))
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+// Connection头部里有keep-alive就保持连接
+bool requestData::wantsKeepAlive() const
+{
+    return hasToken(HDR_CONNECTION, "keep-alive");
+}
+
+/* Accept-Encoding里列了coding(或者*)，并且q值不是0。
+   列表项是"gzip;q=0.5"这样的形式，只需要区分q=0(明确不要)和其他 */
+bool requestData::acceptsEncoding(std::string_view coding) const
+{
+    const string *value = headers.get(HDR_ACCEPT_ENCODING);
+    if (value == NULL)
+        return false;
+    size_t pos = 0;
+    while (pos <= value->size())
+    {
+        size_t end = value->find(',', pos);
+        if (end == string::npos)
+            end = value->size();
+        std::string_view item(value->data() + pos, end - pos);
+        pos = end + 1;
+        std::string_view params;
+        size_t semi = item.find(';');
+        if (semi != std::string_view::npos)
         {
-            if (_pos - pos > 1)
-            {
-                file_name = request_line.substr(pos + 1, _pos - pos - 1); //获取这之间的文件名
-                int __pos = file_name.find('?'); //如果文件名中有?说明还有查询参数
-                if (__pos >= 0)
-                {
-                    file_name = file_name.substr(0, __pos);
-                }
-            }
-                
-            else  //_pos - pos=0,没输入请求的文件名，返回一个预设的页面
-                file_name = "index.html";
+            params = item.substr(semi + 1);
+            item = item.substr(0, semi);
         }
-        pos = _pos;  // 更新当前位置
-        // 解析请求日志
-        LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Processing request: "<<file_name;
+        while (!item.empty() && item.front() == ' ')
+            item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ')
+            item.remove_suffix(1);
+        if (!equalsIgnoreCase(item, coding) && item != "*")
+            continue;
+        while (!params.empty() && params.front() == ' ')
+            params.remove_prefix(1);
+        while (!params.empty() && params.back() == ' ')
+            params.remove_suffix(1);
+        if (params.size() >= 2 && (params[0] == 'q' || params[0] == 'Q') && params[1] == '='
+            && params.find_first_not_of("0.", 2) == std::string_view::npos)
+            return false; // q=0
+        return true;
     }
-    //cout << "file_name: " << file_name << endl;
-    // 检查 HTTP 版本号
-    pos = request_line.find("/", pos);
-    if (pos < 0)
+    return false;
+}
+
+/* POST请求体的长度由Transfer-Encoding: chunked或者Content-length给出。
+   两个都有时按RFC 7230可能是请求走私，直接拒绝；两个都没有就不知道请求体在哪结束，回411 */
+int requestData::prepareBody()
+{
+    const string *te = headers.get(HDR_TRANSFER_ENCODING);
+    const string *length = headers.get(HDR_CONTENT_LENGTH);
+    if (h2_stream)
     {
-        return PARSE_URI_ERROR;
+        // HTTP/2的请求体由带END_STREAM的DATA帧结束，Content-length只用来预先决定放内存还是临时文件
+        if (length != NULL && !length->empty() && length->size() <= 18 && length->find_first_not_of("0123456789") == string::npos)
+            body_left = strtoull(length->c_str(), NULL, 10);
+    }
+    else if (te != NULL)
+    {
+        if (length != NULL)
+        {
+            handleError(fd, 400, "Bad Request");
+            return BODY_ERROR;
+        }
+        std::string_view coding(*te);
+        while (!coding.empty() && (coding.front() == ' ' || coding.front() == '\t'))
+            coding.remove_prefix(1);
+        while (!coding.empty() && (coding.back() == ' ' || coding.back() == '\t'))
+            coding.remove_suffix(1);
+        if (!equalsIgnoreCase(coding, "chunked")) // 只支持单独的chunked，gzip等其他编码不解
+        {
+            handleError(fd, 501, "Not Implemented");
+            return BODY_ERROR;
+        }
+        body_chunked = true;
+        chunked.reset();
+    }
+    else if (length != NULL)
+    {
+        // 不是纯数字，请求头有问题
+        if (length->empty() || length->size() > 18 || length->find_first_not_of("0123456789") != string::npos)
+        {
+            handleError(fd, 400, "Bad Request");
+            return BODY_ERROR;
+        }
+        body_left = strtoull(length->c_str(), NULL, 10); //Content-length的值是字符串数字
     }
     else
     {
-        if (request_line.size() - pos <= 3) //版本号至少3个字节
+        handleError(fd, 411, "Length Required");
+        return BODY_ERROR;
+    }
+    // 表单上传边收边拆成part，body只用来攒其中的图片；其他请求体整个存进body，放不进内存的一开始就写临时文件
+    const string *type = headers.get(HDR_CONTENT_TYPE);
+    string boundary;
+    if (type != NULL && multipartBoundary(*type, boundary))
+    {
+        if (multipart.reset(boundary, this) < 0)
         {
-            return PARSE_URI_ERROR;
+            handleError(fd, 400, "Bad Request");
+            return BODY_ERROR;
         }
-        else
+        body_multipart = true;
+    }
+    else if (!body_chunked && body.reserve(body_left) < 0)
+    {
+        handleError(fd, 500, "Internal Server Error");
+        return BODY_ERROR;
+    }
+    // 上传的客户端(如curl)发请求体前会等100 Continue，请求体还没跟着头部一起到就先回一个，免得对方干等
+    const string *expect = headers.get(HDR_EXPECT);
+    if (expect != NULL && HTTPversion == HTTP_11 && input.empty() && equalsIgnoreCase(*expect, "100-continue"))
+        appendOutput("HTTP/1.1 100 Continue\r\n\r\n");
+    return BODY_SUCCESS;
+}
+
+/* 输入缓冲区里已经到达的请求体直接交给onBodyData，交完就从缓冲区里丢掉，
+   缓冲区只需要装下一次读到的数据，不会随请求体变大；chunked编码时交出的是解码后的正文 */
+int requestData::recvBody()
+{
+    if (!body_chunked)
+    {
+        size_t n = input.size() < body_left ? input.size() : body_left;
+        if (n > 0)
         {
-            string ver = request_line.substr(pos + 1, 3);
-            if (ver == "1.0")
-                HTTPversion = HTTP_10;
-            else if (ver == "1.1")
-                HTTPversion = HTTP_11;
-            else
-                return PARSE_URI_ERROR;
+            if (onBodyData(input.peek(), n) < 0)
+                return BODY_ERROR;
+            input.consume(n);
+            body_left -= n;
+        }
+        return body_left == 0 ? BODY_SUCCESS : BODY_AGAIN;
+    }
+    while (!chunked.done())
+    {
+        if (input.empty())
+            return BODY_AGAIN;
+        const char *data;
+        size_t data_len;
+        ssize_t used = chunked.decode(input.peek(), input.size(), data, data_len);
+        if (used < 0)
+        {
+            handleError(fd, 400, "Bad Request");
+            return BODY_ERROR;
+        }
+        if (data_len > 0 && onBodyData(data, data_len) < 0)
+            return BODY_ERROR;
+        input.consume(used);
+    }
+    return BODY_SUCCESS;
+}
+
+/* 请求体按到达的顺序一段段交到这里。表单上传交给multipart解析器拆成part；
+   其他请求体是整张图片，要拿到全部才能解码，所以存起来留给analysisRequest，
+   超过RequestBody::spill_threshold的部分在临时文件里，内存占用有上限 */
+int requestData::onBodyData(const char *data, size_t len)
+{
+    if (body_multipart)
+    {
+        int ret = multipart.feed(data, len);
+        if (ret == MULTIPART_ERROR)
+            handleError(fd, 400, "Bad Request");
+        return ret < 0 ? BODY_ERROR : BODY_SUCCESS; // 处理函数出错时已经回过错误页了
+    }
+    if (body.append(data, len) < 0)
+    {
+        handleError(fd, 500, "Internal Server Error");
+        return BODY_ERROR;
+    }
+    return BODY_SUCCESS;
+}
+
+/* HTTP/2的一个流开始了。:method和:path换成请求行，:authority当作Host，其余头部照常存起来，
+   之后的接收请求体和分析请求和HTTP/1.x的请求完全一样 */
+int requestData::beginStream(const vector<HpackHeader> &fields)
+{
+    h2_stream = true;
+    HTTPversion = HTTP_2;
+    std::string_view method_name, target;
+    for (auto &field : fields)
+    {
+        if (field.name == ":method")
+            method_name = field.value;
+        else if (field.name == ":path")
+            target = field.value;
+        else if (field.name == ":authority")
+        {
+            if (!headers.has(HDR_HOST))
+                headers.add("host", field.value);
         }
+        else if (field.name.empty() || field.name[0] != ':')
+            headers.add(field.name, field.value);
     }
-    state = STATE_PARSE_HEADERS; //URI解析完成，进入头部解析状态
+    if (setRequestLine(method_name, target) < 0)
+    {
+        state = STATE_FINISH;
+        return PARSE_URI_ERROR;
+    }
+    LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Processing h2 request: "<<file_name;
+    if (method == METHOD_POST)
+    {
+        if (prepareBody() < 0)
+        {
+            state = STATE_FINISH;
+            return PARSE_URI_ERROR;
+        }
+        state = STATE_RECV_BODY;
+    }
+    else
+        state = STATE_ANALYSIS;
     return PARSE_URI_SUCCESS;
 }
 
-// 解析请求的头部
-int requestData::parse_Headers()
+// 一个DATA帧的正文，GET请求带的正文直接丢掉
+int requestData::streamBody(const char *data, size_t len)
 {
-    string &str = content;
-    //key_start 键开始, key_end 键结束, value_start 值开始, value_end 值结束
-    int key_start = -1, key_end = -1, value_start = -1, value_end = -1;
-    int now_read_line_begin = 0; //当前解析位置
-    bool notFinish = true; //是否还未解析完
-    for (int i = 0; i < str.size() && notFinish; ++i)
+    if (state != STATE_RECV_BODY)
+        return BODY_SUCCESS;
+    if (onBodyData(data, len) < 0)
     {
-        switch(h_state)
+        state = STATE_FINISH;
+        return BODY_ERROR;
+    }
+    return BODY_SUCCESS;
+}
+
+// 请求收完了就分析处理；中途出过错的响应里已经是错误页，直接交出去
+void requestData::finishStream(deque<OutChunk> &out)
+{
+    if (state == STATE_RECV_BODY || state == STATE_ANALYSIS)
+        analysisRequest();
+    state = STATE_FINISH;
+    for (auto &chunk : out_chunks)
+        out.push_back(chunk);
+    out_chunks.clear();
+}
+
+// 上传文件名只取最后一段，不允许隐藏文件和控制字符，防止写到上传目录外面
+static bool safeFileName(const string &filename, string &name)
+{
+    size_t slash = filename.find_last_of("/\\");
+    name = filename.substr(slash == string::npos ? 0 : slash + 1);
+    if (name.empty() || name[0] == '.')
+        return false;
+    for (char c : name)
+    {
+        if ((unsigned char)c < 0x20 || c == 0x7f)
+            return false;
+    }
+    return true;
+}
+
+/* 在上传目录里独占地新建文件：O_EXCL保证不覆盖已有的文件，O_NOFOLLOW不跟着符号链接写到别处。
+   同名文件已经存在时在扩展名前加序号(a.txt -> a-1.txt)再试，实际打开的路径写回path；
+   这样出错时abortPart删掉的只会是本次新建的文件 */
+static int createUploadFile(string &path)
+{
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot == string::npos || dot <= slash + 1) // 没有扩展名，或者点在开头
+        dot = path.size();
+    string stem = path.substr(0, dot), ext = path.substr(dot);
+    for (int i = 0; i <= UPLOAD_RENAME_MAX; ++i)
+    {
+        string try_path = i == 0 ? path : stem + "-" + to_string(i) + ext;
+        int file_fd = open(try_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+        if (file_fd >= 0)
         {
-            case h_start: //开始解析行首的键
-            {
-                if (str[i] == '\n' || str[i] == '\r') //这行开始就没了，说明结束了
-                    break;
-                h_state = h_key; //转移到键
-                key_start = i;
-                now_read_line_begin = i;
-                break;
-            }
-            case h_key:  // 开始解析键
-            {
-                if (str[i] == ':')
-                {
-                    key_end = i;
-                    if (key_end - key_start <= 0)
-                        return PARSE_HEADER_ERROR;
-                    h_state = h_colon;
-                }
-                else if (str[i] == '\n' || str[i] == '\r')
-                    return PARSE_HEADER_ERROR;
-                break;  
-            }
-            case h_colon:  // 开始解析冒号
-            {
-                if (str[i] == ' ')
-                {
-                    h_state = h_spaces_after_colon;
-                }
-                else
-                    return PARSE_HEADER_ERROR;
-                break;  
-            }
-            case h_spaces_after_colon:  // 开始解析冒号后的空格
-            {
-                h_state = h_value;
-                value_start = i;
-                break;  
-            }
-            case h_value:  // 开始解析值
-            {
-                if (str[i] == '\r') //遇到回车符了
-                {
-                    h_state = h_CR;
-                    value_end = i;
-                    if (value_end - value_start <= 0)
-                        return PARSE_HEADER_ERROR;
-                }
-                else if (i - value_start > 255)
-                    return PARSE_HEADER_ERROR;
-                break;  
-            }
-            case h_CR:  // 开始解析这一行的回车符
-            {
-                if (str[i] == '\n') //遇到换行符了，说明该行读完，将键值对写入headers
-                {
-                    h_state = h_LF;
-                    string key(str.begin() + key_start, str.begin() + key_end);
-                    string value(str.begin() + value_start, str.begin() + value_end);
-                    headers[key] = value;
-                    now_read_line_begin = i;
-                }
-                else
-                    return PARSE_HEADER_ERROR;
-                break;  
-            }
-            case h_LF:  // 开始解析这一行的换行符
-            {
-                if (str[i] == '\r') //如果又遇到回车符了，说明下一行可能是空行
-                {
-                    h_state = h_end_CR; //进入头部结尾的空行判断
-                }
-                else //当前字符是正常字符，说明是行首重新读
-                {
-                    key_start = i;
-                    h_state = h_key;
-                }
-                break;
-            }
-            case h_end_CR:  // 开始解析下一行是不是头部结尾的空行
-            {
-              if (str[i] == '\n')  // 换行也对了
-                {
-                    h_state = h_end_LF;
-                }
-                else
-                    return PARSE_HEADER_ERROR;
-                break;
-            }
-            case h_end_LF:  // 头部解析完成状态
-            {
-                notFinish = false; //头部解析完了
-                key_start = i;
-                now_read_line_begin = i;
-                break;
-            }
+            path = try_path;
+            return file_fd;
+        }
+        if (errno != EEXIST)
+            return -1;
+    }
+    errno = EEXIST;
+    return -1;
+}
+
+// 用OpenCV库的imdecode函数将收到的图片解码为位图，并用imwrite函数保存到文件 "receive.bmp" 中
+// 图片在内存里或者临时文件的映射里，包成一个Mat头直接解码，不再拷贝成vector<char>
+static int decodeImage(RequestBody &image)
+{
+    static_assert(IMAGE_PART_MAX <= INT_MAX, "cv::Mat length is an int");
+    if (image.empty())
+        return 0;
+    const char *data = image.data();
+    if (data == NULL || image.size() > IMAGE_PART_MAX)
+        return -1;
+    Mat raw(1, (int)image.size(), CV_8UC1, const_cast<char*>(data));
+    Mat test = imdecode(raw, IMREAD_ANYDEPTH|IMREAD_ANYCOLOR);
+    imwrite("receive.bmp", test);
+    return 0;
+}
+
+/* 表单里的文件part：图片攒进body(大了自动转存临时文件)，part结束时交给图片处理；
+   其他文件配置了upload_dir就边收边写进去，否则丢掉；普通字段不处理 */
+int requestData::onPartBegin(const MultipartPart &part)
+{
+    if (part.filename.empty())
+        return BODY_SUCCESS;
+    if (equalsIgnoreCase(std::string_view(part.content_type).substr(0, 6), "image/"))
+    {
+        part_image = true;
+        body.clear();
+        return BODY_SUCCESS;
+    }
+    string name;
+    if (upload_dir.empty() || !safeFileName(part.filename, name))
+        return BODY_SUCCESS;
+    part_path = upload_dir + "/" + name;
+    part_fd = createUploadFile(part_path);
+    if (part_fd < 0)
+    {
+        perror("open upload file failed");
+        handleError(fd, 500, "Internal Server Error");
+        return BODY_ERROR;
+    }
+    return BODY_SUCCESS;
+}
+
+int requestData::onPartData(const char *data, size_t len)
+{
+    if (part_image)
+    {
+        if (body.size() + len > IMAGE_PART_MAX) // 边收边检查，不等攒完整张图才发现太大
+        {
+            handleError(fd, 413, "Payload Too Large");
+            return BODY_ERROR;
+        }
+        if (body.append(data, len) < 0)
+        {
+            handleError(fd, 500, "Internal Server Error");
+            return BODY_ERROR;
+        }
+    }
+    else if (part_fd >= 0 && writen(part_fd, const_cast<char*>(data), len) != (ssize_t)len)
+    {
+        perror("write upload file failed");
+        handleError(fd, 500, "Internal Server Error");
+        return BODY_ERROR;
+    }
+    return BODY_SUCCESS;
+}
+
+int requestData::onPartEnd()
+{
+    if (part_image)
+    {
+        part_image = false;
+        int ret = decodeImage(body);
+        body.clear();
+        if (ret < 0)
+        {
+            handleError(fd, 500, "Internal Server Error");
+            return BODY_ERROR;
         }
     }
-    if (h_state == h_end_LF) //如果for循环解析完了当前状态是h_end_LF，说明成功
+    else if (part_fd >= 0)
     {
-        str = str.substr(now_read_line_begin); //把请求头去掉
-        return PARSE_HEADER_SUCCESS;
+        close(part_fd);
+        part_fd = -1;
+        LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Upload saved: "<<part_path;
+        part_path.clear();
+    }
+    return BODY_SUCCESS;
+}
+
+void requestData::abortPart()
+{
+    part_image = false;
+    if (part_fd >= 0)
+    {
+        close(part_fd);
+        unlink(part_path.c_str());
+        part_fd = -1;
+        part_path.clear();
+    }
+}
+
+/* 解析Range请求头，支持 bytes=a-b、bytes=a-、bytes=-n 及逗号分隔的多个区间。
+   语法不对、区间太多、或者If-Range和文件当前的ETag、Last-Modified都对不上(文件已经变了)时忽略Range，按整个文件处理；
+   If-Range给的是日期时，只有文件mtime比现在早一秒以上才认(RFC 7232 2.2.2)，否则同一秒里改过的文件日期对得上内容却可能已经变了；
+   区间全部落在文件之外返回RANGE_UNSATISFIABLE */
+int requestData::parseRange(const CachedFile &file, vector<ByteRange> &ranges)
+{
+    size_t file_size = file.size;
+    const string *range = headers.get(HDR_RANGE);
+    if (range == NULL)
+        return RANGE_NONE;
+    const string *if_range = headers.get(HDR_IF_RANGE);
+    if (if_range != NULL && *if_range != file.etag) // ETag要强比较，W/开头的对不上
+    {
+        if (*if_range != file.last_modified || file.mtime >= time(NULL) - 1)
+            return RANGE_NONE;
+    }
+    const string &value = *range;
+    if (value.compare(0, 6, "bytes=") != 0)
+        return RANGE_NONE;
+    size_t pos = 6;
+    int spec_num = 0;
+    while (pos <= value.size())
+    {
+        size_t end = value.find(',', pos);
+        if (end == string::npos)
+            end = value.size();
+        // 去掉区间两边的空格
+        size_t b = pos, e = end;
+        while (b < e && value[b] == ' ')
+            ++b;
+        while (e > b && value[e - 1] == ' ')
+            --e;
+        pos = end + 1;
+        if (b == e)
+            continue;
+        if (++spec_num > MAX_RANGES)
+            return RANGE_NONE;
+        size_t dash = value.find('-', b);
+        if (dash == string::npos || dash >= e)
+            return RANGE_NONE;
+        string first = value.substr(b, dash - b), last = value.substr(dash + 1, e - dash - 1);
+        if (first.find_first_not_of("0123456789") != string::npos || last.find_first_not_of("0123456789") != string::npos
+            || first.size() > 18 || last.size() > 18 || (first.empty() && last.empty()))
+            return RANGE_NONE;
+        ByteRange r;
+        if (first.empty()) // -n：最后n个字节
+        {
+            size_t suffix = strtoull(last.c_str(), NULL, 10);
+            if (suffix == 0 || file_size == 0)
+                continue;
+            if (suffix > file_size)
+                suffix = file_size;
+            r.start = file_size - suffix;
+            r.len = suffix;
+        }
+        else
+        {
+            size_t start = strtoull(first.c_str(), NULL, 10);
+            size_t stop = last.empty() ? file_size - 1 : strtoull(last.c_str(), NULL, 10);
+            if (!last.empty() && stop < start)
+                return RANGE_NONE;
+            if (start >= file_size) // 这个区间不可满足，其余区间还可以发
+                continue;
+            if (stop >= file_size)
+                stop = file_size - 1;
+            r.start = start;
+            r.len = stop - start + 1;
+        }
+        ranges.push_back(r);
     }
-    str = str.substr(now_read_line_begin); //不是也去掉，说明这次头部没读完
-    return PARSE_HEADER_AGAIN;
+    if (spec_num == 0)
+        return RANGE_NONE;
+    return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_OK;
 }
 
 // 分析和处理请求
@@ -498,90 +982,203 @@ int requestData::analysisRequest()
 {
     if (method == METHOD_POST) // 处理POST请求
     {
+        if (body_multipart && !multipart.done()) // 请求体结束了还没见到结束分隔符
+        {
+            handleError(fd, 400, "Bad Request");
+            return ANALYSIS_ERROR;
+        }
         //get content
-        char header[MAX_BUFF];
-        sprintf(header, "HTTP/1.1 %d %s\r\n", 200, "OK"); //写响应消息的状态行
-        if(headers.find("Connection") != headers.end() && headers["Connection"] == "keep-alive")
+        ResponseBuilder response(200, "OK"); //写响应消息的状态行
+        if (wantsKeepAlive())
         { //如果有Connection信息且信息是长连接，设置对象为长连接状态并额外写入相关信息
             keep_alive = true;
-            sprintf(header, "%sConnection: keep-alive\r\n", header);
-            sprintf(header, "%sKeep-Alive: timeout=%d\r\n", header, EPOLL_WAIT_TIME);
+            response.add(KEEP_ALIVE_FIELDS);
         }
         //cout << "content=" << content << endl;
         // test char*
         char *send_content = "I have receiced this.";
 
-        sprintf(header, "%sContent-length: %zu\r\n", header, strlen(send_content));
-        sprintf(header, "%s\r\n", header); //响应消息除了消息正文都写完了
-        size_t send_len = (size_t)writen(fd, header, strlen(header)); //非阻塞循环写入cfd
-        if(send_len != strlen(header))
-        {
-            perror("Send header failed");
-            return ANALYSIS_ERROR;
-        }
-        
-        send_len = (size_t)writen(fd, send_content, strlen(send_content)); //把"I have receiced this."也发过去
-        if(send_len != strlen(send_content))
-        {
-            perror("Send content failed");
+        response.add("Content-length", strlen(send_content));
+        appendOutput(response.finish()); //响应消息除了消息正文都写完了，放进发送队列，本轮处理完统一发送
+        appendOutput(send_content, strlen(send_content), shared_ptr<void>()); //把"I have receiced this."也发过去，字面量不需要保活
+        if (body_multipart) // 各个part在收的时候已经处理完了
+            return ANALYSIS_SUCCESS;
+        cout << "content size ==" << body.size() << endl;    //回复对方自己收到的POST请求体大小
+        if (decodeImage(body) < 0)
             return ANALYSIS_ERROR;
-        }
-        cout << "content size ==" << content.size() << endl;    //回复对方自己收到的POST请求体大小
-        vector<char> data(content.begin(), content.end());
-        // 用OpenCV库的imdecode函数将收到的内容解码为位图，并用imwrite函数保存到文件 "receive.bmp" 中
-        Mat test = imdecode(data, IMREAD_ANYDEPTH|IMREAD_ANYCOLOR);
-        imwrite("receive.bmp", test);
         return ANALYSIS_SUCCESS;
     }
     else if (method == METHOD_GET) // 处理GET请求
     {
-        char header[MAX_BUFF];
-        sprintf(header, "HTTP/1.1 %d %s\r\n", 200, "OK");   //写响应消息的状态行
-        if(headers.find("Connection") != headers.end() && headers["Connection"] == "keep-alive")
-        { //如果有Connection信息且信息是长连接，设置对象为长连接状态额外写入相关信息
+        std::string_view filetype = MimeType::getMime(file_name);   //按扩展名获取文件类型，指向静态存储
+        /* 缓存命中时元数据和内容(小文件)或者打开的fd(大文件)都现成，不用stat、open；
+           不存在的文件也记在缓存里，扫描不存在的路径不用每次都查文件系统 */
+        shared_ptr<const CachedFile> cached = FileCacheMgr::GetInstance()->lookup(file_name);
+        if (!cached || !cached->exists())
+        {
+            handleError(fd, 404, "Not Found");
+            return ANALYSIS_ERROR;
+        }
+
+        /* 压缩版本：有不比原文件旧的file.gz就发它，可压缩的小文件就用缓存里在线压好的(还没压好这次先发原文件)。
+           两种情况响应都随Accept-Encoding变化，要带Vary；Range按原文件的字节算，有Range时不发压缩版本 */
+        shared_ptr<const CachedFile> body = cached;
+        bool vary = false;
+        bool gzip = false;
+        if (file_name.size() < 3 || file_name.compare(file_name.size() - 3, 3, ".gz") != 0)
+        {
+            bool wants_gzip = acceptsEncoding("gzip") && headers.get(HDR_RANGE) == NULL;
+            shared_ptr<const CachedFile> sibling = FileCacheMgr::GetInstance()->lookup(file_name + ".gz");
+            if (sibling && sibling->exists() && sibling->mtime >= cached->mtime)
+            {
+                vary = true;
+                if (wants_gzip)
+                {
+                    body = sibling;
+                    gzip = true;
+                }
+            }
+            else if (MimeType::compressible(filetype))
+            {
+                vary = true;
+                shared_ptr<const CachedFile> compressed;
+                if (wants_gzip)
+                    compressed = FileCacheMgr::GetInstance()->gzipped(file_name, cached);
+                if (compressed)
+                {
+                    body = compressed;
+                    gzip = true;
+                }
+            }
+        }
+        size_t file_size = body->size;
+
+        if (wantsKeepAlive())
             keep_alive = true;
-            sprintf(header, "%sConnection: keep-alive\r\n", header);
-            sprintf(header, "%sKeep-Alive: timeout=%d\r\n", header, EPOLL_WAIT_TIME);
+        // 客户端缓存的还是最新的，回304不带正文
+        if (notModified(*body))
+        {
+            ResponseBuilder response(304, "Not Modified");
+            if (keep_alive)
+                response.add(KEEP_ALIVE_FIELDS);
+            response.add(body->validator_fields);
+            if (vary)
+                response.add("Vary: Accept-Encoding\r\n");
+            appendOutput(response.finish());
+            LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Not modified: "<<file_name;
+            return ANALYSIS_SUCCESS;
         }
-        int dot_pos = file_name.find('.');
-        const char* filetype;   //用getMine获取文件类型
-        if (dot_pos < 0) 
-            filetype = MimeType::getMime("default").c_str();
-        else
-            filetype = MimeType::getMime(file_name.substr(dot_pos)).c_str();
-        struct stat sbuf;
-        if (stat(file_name.c_str(), &sbuf) < 0) //获取文件状态sbuf，如果返回值<0则文件未找到
+
+        // 断点续传/拖动进度条：只发Range要求的区间
+        vector<ByteRange> ranges;
+        int range_flag = parseRange(*body, ranges);
+        if (range_flag == RANGE_UNSATISFIABLE)
         {
-            handleError(fd, 404, "Not Found!");
+            handleError(fd, 416, "Range Not Satisfiable", "Content-range: bytes */" + to_string(file_size) + "\r\n");
             return ANALYSIS_ERROR;
         }
-        // 返回文件类型
-        sprintf(header, "%sContent-type: %s\r\n", header, filetype);
-        // 返回文件大小
-        sprintf(header, "%sContent-length: %ld\r\n", header, sbuf.st_size);
+        //写响应消息的状态行
+        ResponseBuilder response(range_flag == RANGE_OK ? 206 : 200, range_flag == RANGE_OK ? "Partial Content" : "OK");
+        if (keep_alive) //如果有Connection信息且信息是长连接，额外写入相关信息
+            response.add(KEEP_ALIVE_FIELDS);
+        response.add("Accept-Ranges: bytes\r\n");
+        response.add(body->validator_fields); // ETag和Last-Modified在缓存条目里拼好了
+        if (vary)
+            response.add("Vary: Accept-Encoding\r\n");
+        if (gzip)
+            response.add("Content-Encoding: gzip\r\n");
 
-        sprintf(header, "%s\r\n", header); // 响应消息除了消息正文都写完了
-        size_t send_len = (size_t)writen(fd, header, strlen(header)); // 非阻塞循环写入cfd
-        if(send_len != strlen(header))
+        // 每段要发送的正文，多区间时前面还有各自的分段头
+        vector<string> part_headers;
+        string boundary, tail;
+        if (ranges.size() > 1)
         {
-            perror("Send header failed");
-            return ANALYSIS_ERROR;
-        } // 非消息正文发送完毕
-
-        // 打开文件开始发送消息正文
-        int src_fd = open(file_name.c_str(), O_RDONLY, 0);
-        // 用mmap将文件映射到内存中。这样做可以将文件内容映射到一块内存区域，避免了频繁的磁盘I/O操作
-        char *src_addr = static_cast<char*>(mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0));
-        close(src_fd); // 内存映射完毕，不需要文件了
-    
-        // 发送文件并校验完整性
-        send_len = writen(fd, src_addr, sbuf.st_size);
-        if(send_len != sbuf.st_size) //发送的字节数不等于该文件的大小
-        {
-            perror("Send file failed");
-            return ANALYSIS_ERROR;
+            // multipart/byteranges：每个区间一段，分段头里带自己的Content-type和Content-range
+            char boundary_buff[64];
+            sprintf(boundary_buff, "BYTERANGES_%08lx%08lx", (unsigned long)body->mtime, (unsigned long)file_size);
+            boundary = boundary_buff;
+            size_t content_length = 0;
+            for (auto &r : ranges)
+            {
+                part_headers.push_back("\r\n--" + boundary + "\r\nContent-type: " + string(filetype)
+                    + "\r\nContent-range: bytes " + to_string(r.start) + "-" + to_string(r.start + r.len - 1)
+                    + "/" + to_string(file_size) + "\r\n\r\n");
+                content_length += part_headers.back().size() + r.len;
+            }
+            tail = "\r\n--" + boundary + "--\r\n";
+            content_length += tail.size();
+            response.add("Content-type", "multipart/byteranges; boundary=" + boundary);
+            response.add("Content-length", content_length);
+        }
+        else
+        {
+            // 返回文件类型
+            response.add("Content-type", filetype);
+            if (ranges.empty()) // 没有Range就是整个文件，正文大小在缓存条目里拼好了
+            {
+                ByteRange all = {0, file_size};
+                ranges.push_back(all);
+                response.add(body->length_field);
+            }
+            else
+            {
+                response.add("Content-range", "bytes " + to_string(ranges[0].start) + "-"
+                    + to_string(ranges[0].start + ranges[0].len - 1) + "/" + to_string(file_size));
+                // 返回正文大小
+                response.add("Content-length", ranges[0].len);
+            }
+        }
+
+        appendOutput(response.finish()); // 响应消息除了消息正文都写完了，非消息正文放进发送队列
+
+        if (file_size == 0) // 空文件没有正文，也无法映射
+            return ANALYSIS_SUCCESS;
+        if (body->kind == CACHED_MEMORY) // 正文直接从缓存的内存发送，条目随发送队列保活，发送期间被淘汰或失效也不会释放
+        {
+            shared_ptr<void> owner = const_pointer_cast<CachedFile>(body);
+            for (size_t i = 0; i < ranges.size(); ++i)
+            {
+                if (!part_headers.empty())
+                    appendOutput(part_headers[i]);
+                appendOutput(body->data.data() + ranges[i].start, ranges[i].len, owner);
+            }
+            if (!tail.empty())
+                appendOutput(tail);
+            LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Response sent: "<<file_name;
+            return ANALYSIS_SUCCESS;
+        }
+        // 大文件用缓存条目里打开的fd发送，sendfile/splice带偏移读，多个连接共用一个fd也互不影响
+        int src_fd = body->fd;
+        shared_ptr<void> file_owner;
+        char *src_addr = NULL;
+        if (Poller::file_mode != FILE_SEND_MMAP)
+        {
+            // sendfile/splice直接从页缓存发送，不用建立和拆除映射，也没有用户态拷贝；条目随发送队列保活，发完才可能关闭fd
+            file_owner = const_pointer_cast<CachedFile>(body);
+        }
+        else
+        {
+            // 用mmap将文件映射到内存中。这样做可以将文件内容映射到一块内存区域，避免了频繁的磁盘I/O操作
+            src_addr = static_cast<char*>(mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, src_fd, 0));
+            if (src_addr == MAP_FAILED)
+            {
+                perror("mmap failed");
+                return ANALYSIS_ERROR;
+            }
+            // 映射区随发送队列一起保活，发送完成(io_uring下可能在之后的某一轮)才解除内存映射关系
+            file_owner = shared_ptr<void>(src_addr, [file_size](void *addr) { munmap(addr, file_size); });
+        }
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (!part_headers.empty())
+                appendOutput(part_headers[i]);
+            if (src_addr)
+                appendOutput(src_addr + ranges[i].start, ranges[i].len, file_owner);
+            else
+                appendFile(src_fd, ranges[i].start, ranges[i].len, file_owner);
         }
-        munmap(src_addr, sbuf.st_size); //解除内存映射关系
+        if (!tail.empty())
+            appendOutput(tail);
         // 响应请求日志
         LOG_INFO(LoggerMgr::GetInstance()->getLogger("SERVER")) << "Response sent: "<<file_name;
         return ANALYSIS_SUCCESS;
@@ -589,101 +1186,66 @@ int requestData::analysisRequest()
     else //其他请求类型返回分析请求错误
         return ANALYSIS_ERROR;
 }
-// 请求文件没找到时回发错误网页
-// 调用代码 handleError(fd, 404, "Not Found!");
-void requestData::handleError(int fd, int err_num, string short_msg)
-{
-    short_msg = " " + short_msg;
-    char send_buff[MAX_BUFF];
-    string body_buff, header_buff;
-    body_buff += "<html><title>TKeed Error</title>";
-    body_buff += "<body bgcolor=\"ffffff\">";
-    body_buff += to_string(err_num) + short_msg;
-    body_buff += "<hr><em> My Web Server</em>\n</body></html>";
-
-    header_buff += "HTTP/1.1 " + to_string(err_num) + short_msg + "\r\n";
-    header_buff += "Content-type: text/html\r\n";
-    header_buff += "Connection: close\r\n";
-    header_buff += "Content-length: " + to_string(body_buff.size()) + "\r\n";
-    header_buff += "\r\n";
-    sprintf(send_buff, "%s", header_buff.c_str());
-    writen(fd, send_buff, strlen(send_buff));
-    sprintf(send_buff, "%s", body_buff.c_str());
-    writen(fd, send_buff, strlen(send_buff));
-}
-
-// 初始化定时器
-mytimer::mytimer(shared_ptr<requestData> _request_data, int timeout): 
-    deleted(false), 
-    request_data(_request_data)
+/* 条件GET(RFC 9110 13.2.2)：有If-None-Match就只看它，列表里有和file弱比较相同的ETag或者*就是没改过；
+   没有If-None-Match才看If-Modified-Since，文件的mtime不晚于它给的时间就是没改过。校验值都在缓存条目里，不用stat */
+bool requestData::notModified(const CachedFile &file) const
 {
-    cout << "mytimer()" << endl;
-    struct timeval now;
-    gettimeofday(&now, NULL); //获取当前时间
-    // 以毫秒计
-    expired_time = ((now.tv_sec * 1000) + (now.tv_usec / 1000)) + timeout;
-}
-
-// 定时器销毁
-mytimer::~mytimer()
-{
-    cout << "~mytimer()" << endl;
-    if (request_data)   //如果请求对象还在，要将其下树
+    const string *if_none_match = headers.get(HDR_IF_NONE_MATCH);
+    if (if_none_match != NULL)
     {
-        Epoll::epoll_del(request_data->getFd(), EPOLLIN | EPOLLET | EPOLLONESHOT);
+        std::string_view etag(file.etag);
+        size_t pos = 0;
+        while (pos <= if_none_match->size())
+        {
+            size_t end = if_none_match->find(',', pos);
+            if (end == string::npos)
+                end = if_none_match->size();
+            std::string_view item(if_none_match->data() + pos, end - pos);
+            pos = end + 1;
+            while (!item.empty() && item.front() == ' ')
+                item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ')
+                item.remove_suffix(1);
+            if (item.compare(0, 2, "W/") == 0) // 弱比较不管W/前缀
+                item.remove_prefix(2);
+            if (item == "*" || item == etag)
+                return true;
+        }
+        return false;
     }
+    const string *if_modified_since = headers.get(HDR_IF_MODIFIED_SINCE);
+    if (if_modified_since == NULL)
+        return false;
+    time_t since = parseHttpDate(*if_modified_since);
+    return since != -1 && file.mtime <= since;
 }
-// 更新定时器的超时时间，没用到
-void mytimer::update(int timeout)
-{
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    expired_time = ((now.tv_sec * 1000) + (now.tv_usec / 1000)) + timeout;
-}
-// 判断定时器是否有效，还未超时，用于handle_expired_event()检查定时器队列
-bool mytimer::isvalid()
+
+// 请求文件没找到时回发错误网页
+// 调用代码 handleError(fd, 404, "Not Found");
+// 常见的错误有启动时拼好的整个响应，只填上Date；带额外头部的(416)或者不常见的才现拼
+void requestData::handleError(int fd, int err_num, string short_msg, const string &extra_header)
 {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    size_t temp = ((now.tv_sec * 1000) + (now.tv_usec / 1000));
-    if (temp < expired_time)
-    {
-        return true;
-    }
-    else
+    if (extra_header.empty())
     {
-        this->setDeleted();
-        return false;
+        shared_ptr<string> canned = cannedResponse(err_num);
+        if (canned)
+        {
+            appendOutput(canned);
+            return;
+        }
     }
-}
-// 清除当前定时器的请求对象
-void mytimer::clearReq()
-{
-    request_data.reset();
-    this->setDeleted();
-}
-// 表示当前定时器已被删除，分离或超时都会导致删除
-void mytimer::setDeleted()
-{
-    deleted = true;
-}
-// 查看当前定时器的删除状态
-bool mytimer::isDeleted() const
-{
-    return deleted;
-}
-// 获取当前定时器的超时时间
-size_t mytimer::getExpTime() const
-{
-    return expired_time;
-}
-// 定时器队列比较定时器的超时时间，小顶堆排序
-bool timerCmp::operator()(shared_ptr<mytimer> &a, shared_ptr<mytimer> &b) const
-{
-    return a->getExpTime() > b->getExpTime();
+    shared_ptr<string> body_buff(new string(errorPage(err_num, short_msg)));
+    ResponseBuilder response(err_num, short_msg);
+    response.add("Content-type", "text/html");
+    response.add("Connection", "close");
+    response.add(extra_header);
+    response.add("Content-length", body_buff->size());
+    appendOutput(response.finish());
+    appendOutput(body_buff);
 }
 
-MutexLockGuard::MutexLockGuard()
+MutexLockGuard::MutexLockGuard(pthread_mutex_t &_lock):
+    lock(_lock)
 {
     pthread_mutex_lock(&lock);
 }
@@ -3,153 +3,173 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <deque>
+#include <vector>
+#include "poller.h"
+#include "inputBuffer.h"
+#include "httpHeaders.h"
+#include "chunkedDecoder.h"
+#include "requestBody.h"
+#include "multipartParser.h"
+#include "hpack.h"
+#include "timerWheel.h"
 
 
 /*
 在处理 HTTP 请求时跟踪请求的处理进度：
-STATE_PARSE_URI：解析请求的
-URI状态。服务器正在解析客户端请求中的URI部分，以确定请求的资源路径
-STATE_PARSE_HEADERS：解析请求头状态。服务器正在解析客户端请求中的头部信息
-STATE_RECV_BODY：接收请求体状态。服务器正在接收客户端请求的主体部分，例如POST请求的主体内容。
+STATE_PARSE_URI：解析请求行和请求头状态。服务器等请求行和全部头部收齐后一次解析完，以确定请求的资源路径和头部信息
+STATE_RECV_BODY：接收请求体状态。服务器正在接收客户端请求的主体部分，例如POST请求的主体内容，按Content-length或chunked编码边收边交给处理函数。
 STATE_ANALYSIS：分析和处理请求状态。服务器正在分析客户端请求的内容，并做相应的处理。
 STATE_FINISH：请求处理完成状态。服务器已经完成对客户端请求的处理，并准备好返回响应。
 */
 const int STATE_PARSE_URI = 1;
-const int STATE_PARSE_HEADERS = 2;
 const int STATE_RECV_BODY = 3;
 const int STATE_ANALYSIS = 4;
 const int STATE_FINISH = 5;
 
-const int MAX_BUFF = 4096;
-
 // 有请求出现但是读不到数据,可能是请求终止，或者来自网络的数据没有达到等原因
 // 对这样的请求尝试超过一定的次数就断开放弃
 const int AGAIN_MAX_TIMES = 200;
 
-// 对于解析请求URI
-const int PARSE_URI_AGAIN = -1;   // 需要再次解析 URI，如一次没读完
-const int PARSE_URI_ERROR = -2;   // 解析 URI 发生错误
-const int PARSE_URI_SUCCESS = 0;  // 解析 URI 成功
-// 对于解析请求头
-const int PARSE_HEADER_AGAIN = -1;  // 需要再次解析头部，如一次没读完
-const int PARSE_HEADER_ERROR = -2;   // 解析头部发生错误
-const int PARSE_HEADER_SUCCESS = 0;  // 解析头部成功
+// 流水线(pipelining)上一次最多连续应答的请求数，用完就让出线程，剩下的请求下一轮再处理，免得一个连接霸占事件循环
+const int MAX_PIPELINE_REQUESTS = 16;
+
+// 对于解析请求行和请求头
+const int PARSE_URI_AGAIN = -1;   // 需要再次解析，如头部一次没读完
+const int PARSE_URI_ERROR = -2;   // 解析发生错误
+const int PARSE_URI_SUCCESS = 0;  // 解析成功
+const int PARSE_URI_H2 = 1;       // 连接切换到了HTTP/2，之后的数据都是帧
+
+// 对于接收请求体
+const int BODY_AGAIN = -1;    // 请求体还没收完
+const int BODY_ERROR = -2;    // 请求体格式错误
+const int BODY_SUCCESS = 0;   // 请求体收完了
 
 const int ANALYSIS_ERROR = -2;   // 分析请求出错
 const int ANALYSIS_SUCCESS = 0;  // 分析请求成功
 
+// 对于解析Range请求头
+const int RANGE_NONE = 0;            // 没有Range或按规定忽略Range，发送整个文件
+const int RANGE_OK = 1;              // 得到了要发送的区间
+const int RANGE_UNSATISFIABLE = -1;  // 区间全在文件之外，回416
+const int MAX_RANGES = 16;           // 一个请求最多接受的区间数，再多就当作没有Range，防止被切成大量碎片
+
+const int UPLOAD_RENAME_MAX = 100;  // 上传文件重名时最多试这么多个带序号的新名字
+const size_t IMAGE_PART_MAX = 64 << 20; // 单个图片part最大字节数，超过回413；imdecode的Mat长度是int，这个值不能超过INT_MAX
+
 const int METHOD_POST = 1;  // POST请求的标识
 const int METHOD_GET = 2;   // GET请求的标识
 const int HTTP_10 = 1;      // HTTP/1.0 版本的标识
-const int HTTP_11 = 2;      // HTTP/2.0 版本的标识
+const int HTTP_11 = 2;      // HTTP/1.1 版本的标识
+const int HTTP_2 = 3;       // HTTP/2 版本的标识，请求来自h2c连接上的一个流
 
 const int EPOLL_WAIT_TIME =
     500;  // epoll等待事件的最大时间间隔，单位为毫秒，告知对方要在这一时间内保持活跃
+const int SEND_WAIT_TIME =
+    5000;  // 响应没发完时等socket可写的最长时间，单位为毫秒，超时说明对方不再读了
 
-// 用于获取文件后缀对应的 MIME
-// 类型，禁止外部实例化，只提供getMine方法，都是静态成员，故调用方法也不需要实例化
-class MimeType {
- private:
-  static pthread_mutex_t lock;
-  static std::unordered_map<std::string, std::string>
-      mime;  // 存储文件后缀与 MIME 类型的对应关系
-  MimeType();
-  MimeType(
-      const MimeType &
-          m);  // 将默认构造和拷贝构造函数都设为private私有化，将禁止外部进行实例化
- public:
-  static std::string getMime(
-      const std::string &suffix);  // 接收一个字符串，返回文件类型
-};
-
-enum HeadersState {
-    h_start = 0,           // 当前解析状态，默认从行首开始
-    h_key,                 // 正在解析头部中的键
-    h_colon,               // 解析到了键值对的冒号
-    h_spaces_after_colon,  // 解析到了冒号后的空格
-    h_value,               // 正在解析键值对的值
-    h_CR,                  // 解析到了回车符
-    h_LF,                  // 解析到了换行符
-    h_end_CR,              // 解析到了头部结束的回车符
-    h_end_LF               // 解析到了头部结束的换行符，此时说明头部解析完成
-}; // 定义解析 HTTP 请求头部时每一行的状态
-
-struct mytimer;
 class requestData;
+class Epoll;
+class Http2Session;
+struct CachedFile;
+
+// Range请求里的一个字节区间，已按文件大小校正
+struct ByteRange
+{
+    size_t start;
+    size_t len;
+};
 
 // 请求类，封装了用于处理 HTTP请求所需的数据和方法，也就是事件信息ev，最终上树的结点是epv，epv.data.ptr=ev
-class requestData : public std::enable_shared_from_this<requestData>
+// multipart/form-data上传时自己接收解析出的各个part
+class requestData : public std::enable_shared_from_this<requestData>, private MultipartHandler
 {
 private:
-    // content的内容边读边清
-    std::string content;    // 请求的内容
+    // 输入缓冲区边读边清，解析时直接在它的视图上进行
+    InputBuffer input;      // 请求的内容
     int method;             // HTTP 请求的方法（GET、POST 等）
     int HTTPversion;        // HTTP 协议的版本
     std::string file_name;  // 请求的文件名
-    int now_read_pos;       // 当前读取位置
+    RequestBody body;       // POST的请求体，由onBodyData一段段存起来，大了转存到临时文件；缓冲区里只留流水线上后面的请求
+    bool body_chunked;      // 请求体是Transfer-Encoding: chunked编码的
+    size_t body_left;       // 按Content-length还没收到的请求体字节数
+    ChunkedDecoder chunked; // chunked请求体的解码状态，数据分几次到达时接着解
+    bool body_multipart;    // 请求体是multipart/form-data，边收边拆成part
+    MultipartParser multipart;
+    bool part_image;        // 当前part是图片，正文存进body，part结束时交给图片处理
+    int part_fd;            // 当前part要保存成的上传文件，-1表示不保存
+    std::string part_path;
     int state;              // 请求的状态
-    int h_state;            // 处理请求头的状态
+    size_t header_scanned;  // 输入缓冲区开头已经确认没有头部结尾的字节数，头部分几次到达时从这里接着找
     bool isfinish;          // 请求是否处理完成的标志
     bool keep_alive;        // 是否保持连接的标志
     int againTimes;    // 用于记录请求重新尝试的次数
     std::string path;  // 请求访问的路径。
     int fd;            // 与请求相关联的文件描述符
-    int epollfd;       // 与请求相关联的 epoll 文件描述符
-    std::unordered_map<std::string, std::string> headers;  // 请求的头部信息
-    std::weak_ptr<mytimer> timer; 
-    //用weak_ptr管理请求超时的计时器，因为请求类和定时器类里都有成员变量指向对方，故把一个改成弱引用防止循环引用
+    Epoll *loop;       // 连接所属的事件循环，上树、下树和定时器都交给它
+    HttpHeaders headers;    // 请求的头部信息，常用头部按HeaderId直接取
+    TimerNode timer;        // 等下一个请求或等socket可写时的超时定时器，嵌在对象里，每次都挂回所属循环的时间轮，不用重新分配
+    std::deque<OutChunk> out_chunks; // 本轮待发送的响应，处理完一起交给事件循环发送
+    const char *in_data;    // 轮询器(io_uring)已经收好的数据，连接不再自己read
+    int in_len;
+    bool writing;           // 响应没发完，正在等EPOLLOUT
+    bool close_after_write; // 响应发完后关闭连接(短连接或出错)
+    bool pipelined;         // 本轮预算用完时缓冲区或socket里还有请求，要让事件循环再调度一次
+    std::unique_ptr<Http2Session> h2; // 连接切换到HTTP/2后的会话，读到的数据都交给它
+    bool h2_stream;         // 自己是HTTP/2连接上的一个流，没有socket，响应由会话取走发送
 
 private:
-    int parse_URI();        // 解析请求的 URI
-    int parse_Headers();    // 解析请求的头部信息
+    int parse_Request();    // 解析请求行和请求头
+    int setRequestLine(std::string_view method_name, std::string_view target); // 方法、文件名，HTTP/2的伪头部也走这里
+    bool hasToken(HeaderId id, std::string_view token) const; // 逗号分隔的头部值里有token(不区分大小写)
+    bool wantsKeepAlive() const; // 请求头要求长连接
+    bool acceptsEncoding(std::string_view coding) const; // Accept-Encoding接受coding
+    int prepareBody();      // 按请求头确定请求体怎么接收
+    int recvBody();         // 把输入缓冲区里已经到达的请求体交给onBodyData，收完返回BODY_SUCCESS
+    int onBodyData(const char *data, size_t len); // 处理一段请求体，出错返回BODY_ERROR
+    int onPartBegin(const MultipartPart &part);   // multipart的一个part开始，决定正文交给谁
+    int onPartData(const char *data, size_t len);
+    int onPartEnd();
+    void abortPart();       // 请求中途出错或断开，删掉写了一半的上传文件
     int analysisRequest();  // 分析处理请求
+    int parseRange(const CachedFile &file, std::vector<ByteRange> &ranges); // 解析Range/If-Range
+    bool notModified(const CachedFile &file) const; // 条件GET的校验值对得上，回304
+    void appendOutput(const std::string &str);  // 追加一段响应，内容拷贝一份保存
+    void appendOutput(const std::shared_ptr<std::string> &str); // 追加一段单独分配的响应，不拷贝，随发送队列保活
+    void appendOutput(const char *data, size_t len, std::shared_ptr<void> owner); // 追加一段由owner保活的响应
+    void appendFile(int file_fd, off_t offset, size_t len, std::shared_ptr<void> owner); // 追加从文件offset处发送的len字节
+    void nextRequest();     // 长连接上一个请求应答完，清空解析状态准备解析缓冲区里的下一个
 
 public:
+    static std::string upload_dir;  // multipart上传的文件保存到这个目录，为空时不保存，启动时设置一次
 
     requestData();
-    requestData(int _epollfd, int _fd, std::string _path);
+    requestData(Epoll *_loop, int _fd, std::string _path);
     ~requestData();
-    void addTimer(std::shared_ptr<mytimer> mtimer); //给请求对象添加计时器
+    void addTimer(int timeout); // 挂上或刷新timeout毫秒后超时的定时器
     void reset();          // 重置请求数据
     void seperateTimer();  // 分离计时器
     int getFd();           // 获取文件描述符
+    Epoll *getLoop();      // 获取所属事件循环
     void setFd(int _fd);   // 设置文件描述符
+    void feedInput(const char *data, int len); // 交给连接轮询器已收到的数据，仅在本次handleRequest内有效
     void handleRequest();  // 处理请求
-    void handleError(int fd, int err_num, std::string short_msg);  // 处理错误
-};
-
-//定时器对象，用来管理请求对象的超时是否，若超时则进行处理
-struct mytimer
-{
-    bool deleted; //表示定时器是否被删除，1表示已经删除
-    size_t expired_time; //定时器的超时时间
-    std::shared_ptr<requestData> request_data; //定时器关联的请求对象
-
-    mytimer(std::shared_ptr<requestData> _request_data, int timeout); //接收一个事件请求对象和超时时间来初始化
-    ~mytimer();
-    void update(int timeout);   // 更新定时器的超时时间
-    bool isvalid();             // 检查定时器是否有效，即是否超时
-    void clearReq();            // 清除当前的请求对象并调用setDeleted()
-    void setDeleted();          // 将定时器标记为已删除
-    bool isDeleted() const;     // 检查定时器是否已被删除
-    size_t getExpTime() const;  // 获取定时器的超时时间
-};
-
-// 定时器优先级队列的排序规则(小顶堆)
-struct timerCmp
-{
-    bool operator()(std::shared_ptr<mytimer> &a, std::shared_ptr<mytimer> &b) const;
+    void handleError(int fd, int err_num, std::string short_msg, const std::string &extra_header = "");  // 处理错误
+    // 作为HTTP/2的一个流：头部由会话解码好交进来，请求体是DATA帧，请求结束时取走响应
+    int beginStream(const std::vector<HpackHeader> &fields);  // 出错返回负数，能回错误页的已经放进响应了
+    int streamBody(const char *data, size_t len);              // 出错返回BODY_ERROR
+    void finishStream(std::deque<OutChunk> &out);              // 处理请求，把响应(HTTP/1.1格式)移到out
 };
 
 //定义互斥锁类，实现自动加/解锁
 class MutexLockGuard
 {
 public:
-    explicit MutexLockGuard();
+    explicit MutexLockGuard(pthread_mutex_t &_lock);
     ~MutexLockGuard();
 
 private:
-    static pthread_mutex_t lock; // 静态成员变量，锁唯一
+    pthread_mutex_t &lock; // 所保护资源自己的锁，如各事件循环的定时器锁
 
 private:
     MutexLockGuard(const MutexLockGuard&);
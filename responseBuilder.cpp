@@ -0,0 +1,113 @@
+#include "responseBuilder.h"
+#include "util.h"
+#include <charconv>
+#include <vector>
+#include <string.h>
+
+ResponseBuilder::ResponseBuilder(int status, std::string_view reason):
+    head(new std::string)
+{
+    head->reserve(RESPONSE_HEAD_RESERVE);
+    head->append("HTTP/1.1 ");
+    add(std::string_view(), (size_t)status);
+    head->push_back(' ');
+    head->append(reason);
+    head->append("\r\nDate: ");
+    head->append(httpDateNow());
+    head->append("\r\n");
+}
+
+void ResponseBuilder::add(std::string_view fields)
+{
+    head->append(fields);
+}
+
+void ResponseBuilder::add(std::string_view name, std::string_view value)
+{
+    head->append(name);
+    head->append(": ");
+    head->append(value);
+    head->append("\r\n");
+}
+
+// name为空时只写数字，状态码也走这里
+void ResponseBuilder::add(std::string_view name, size_t value)
+{
+    char digits[24];
+    char *end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    if (name.empty())
+    {
+        head->append(digits, end - digits);
+        return;
+    }
+    add(name, std::string_view(digits, end - digits));
+}
+
+std::shared_ptr<std::string> ResponseBuilder::finish()
+{
+    head->append("\r\n");
+    return head;
+}
+
+std::string errorPage(int status, std::string_view reason)
+{
+    std::string body;
+    body += "<html><title>TKeed Error</title>";
+    body += "<body bgcolor=\"ffffff\">";
+    body += std::to_string(status);
+    body += " ";
+    body += reason;
+    body += "<hr><em> My Web Server</em>\n</body></html>";
+    return body;
+}
+
+// 一个预先拼好的错误响应
+struct Canned
+{
+    int status;
+    std::string text;
+    size_t date_pos;    // Date的值在text里的位置
+};
+
+// 进程启动时(main之前)拼好，之后只读
+static std::vector<Canned> buildCanned()
+{
+    static const struct { int status; const char *reason; } table[] = {
+        {400, "Bad Request"},
+        {404, "Not Found"},
+        {411, "Length Required"},
+        {413, "Payload Too Large"},
+        {431, "Request Header Fields Too Large"},
+        {500, "Internal Server Error"},
+        {501, "Not Implemented"},
+        {503, "Service Unavailable"},
+    };
+    std::vector<Canned> canned;
+    for (auto &entry : table)
+    {
+        ResponseBuilder response(entry.status, entry.reason);
+        std::string body = errorPage(entry.status, entry.reason);
+        response.add("Content-type", "text/html");
+        response.add("Connection", "close");
+        response.add("Content-length", body.size());
+        std::string text = *response.finish() + body;
+        canned.push_back(Canned{entry.status, text, text.find("\r\nDate: ") + 8});
+    }
+    return canned;
+}
+
+static const std::vector<Canned> canned_responses = buildCanned();
+
+std::shared_ptr<std::string> cannedResponse(int status)
+{
+    for (auto &canned : canned_responses)
+    {
+        if (canned.status != status)
+            continue;
+        std::shared_ptr<std::string> text(new std::string(canned.text));
+        const std::string &date = httpDateNow();
+        memcpy(&(*text)[canned.date_pos], date.data(), date.size()); // IMF-fixdate定长，和模板里的一样长
+        return text;
+    }
+    return std::shared_ptr<std::string>();
+}
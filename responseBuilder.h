@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <stddef.h>
+
+const size_t RESPONSE_HEAD_RESERVE = 512;   // 响应头部一开始就分配这么大，常见的头部拼完都不用再扩容
+
+/* 拼HTTP/1.1响应头部。状态行和Date一开始就写好，之后每一段都直接追加在预先分配的缓冲区末尾，
+   不再sprintf(header, "%s...", header)把已经写好的部分反复拷贝；整行的片段(如缓存条目里拼好的ETag和Last-Modified)原样追加。
+   finish()加上结束的空行，返回的缓冲区交给发送队列保活，不用再拷一次 */
+class ResponseBuilder
+{
+private:
+    std::shared_ptr<std::string> head;
+
+public:
+    ResponseBuilder(int status, std::string_view reason);
+    void add(std::string_view fields);                      // 已经拼好的一行或几行，每行带\r\n
+    void add(std::string_view name, std::string_view value);
+    void add(std::string_view name, size_t value);
+    std::shared_ptr<std::string> finish();
+};
+
+std::string errorPage(int status, std::string_view reason);    // 错误响应的正文
+/* 启动时拼好的常见错误响应(状态行、头部、正文一整块)，没有的返回NULL。
+   模板里给Date留了位置，每次拷一份填上当前时间，一次就能写出去 */
+std::shared_ptr<std::string> cannedResponse(int status);
@@ -0,0 +1,36 @@
+#!/bin/bash
+# 同一个长连接上连续要几个大文件(走MSG_ZEROCOPY和fd缓存的路径)，每个都要完整收到，且全程只建一次连接。
+# 零拷贝的完成通知以EPOLLERR报上来，处理不好时连接会收不到后面的请求(卡住或被重置，curl会悄悄重连)
+# 用法: ./keepalive_large.sh   需要先在上级目录make出myserver
+cd "$(dirname "$0")"
+SERVER=${SERVER:-../myserver}
+PORT=${PORT:-8898}
+DATA=${DATA:-/tmp/keepalive_test}
+REQUESTS=4
+
+mkdir -p $DATA
+[ -f $DATA/256k.bin ] || head -c 262144 /dev/urandom > $DATA/256k.bin
+[ -f $DATA/2m.bin ] || head -c 2097152 /dev/urandom > $DATA/2m.bin
+
+fail=0
+for mode in "--reactors 2" "--reactors 2 --filesend mmap" "--reactors 2 --file-cache 0" ""; do
+    $SERVER $PORT $DATA $mode > /dev/null 2>&1 &
+    pid=$!
+    sleep 0.5
+    for file in 256k.bin 2m.bin; do
+        size=$(stat -c %s $DATA/$file)
+        args=""
+        for i in $(seq $REQUESTS); do
+            args="$args -o /dev/null http://127.0.0.1:$PORT/$file"
+        done
+        # 每个请求输出一行: 状态码 收到的字节数 这次新建的连接数
+        out=$(curl -s -m 10 -H "Connection: keep-alive" -w "%{http_code} %{size_download} %{num_connects}\n" $args)
+        ok=$(echo "$out" | awk -v size=$size '$1 == 200 && $2 == size { n++ } { c += $3 } END { print (n == NR && c == 1) ? "ok" : "FAIL" }')
+        [ "$(echo "$out" | wc -l)" -eq $REQUESTS ] || ok=FAIL
+        echo "[$mode] $file: $ok"
+        [ "$ok" = ok ] || { echo "$out"; fail=1; }
+    done
+    kill $pid
+    wait $pid 2>/dev/null || true
+done
+exit $fail
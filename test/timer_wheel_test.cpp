@@ -0,0 +1,138 @@
+#include "../timerWheel.h"
+#include <stdio.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+// 时间轮的单元测试：长时间空闲后再挂定时器、远处有定时器时空闲很久，以及和逐个比较到期时间的参照模型随机对比
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static double elapsedMs(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// 空着的时间轮停了一天，再挂一个500毫秒的定时器：下一次醒来不能在过去，推进也不能一毫秒一毫秒地补
+static void testIdleThenAdd()
+{
+    TimerWheel wheel;
+    TimerNode node;
+    std::vector<TimerNode*> expired;
+    uint64_t now = 1000;
+    wheel.init(now);
+    now += 86400000ULL;
+    wheel.add(&node, now + 500, now);
+    uint64_t next = wheel.nextExpire();
+    CHECK(next > now && next <= now + 500);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    wheel.advance(now + 499, expired);
+    CHECK(expired.empty());
+    wheel.advance(now + 500, expired);
+    CHECK(expired.size() == 1 && expired[0] == &node);
+    CHECK(wheel.size() == 0);
+    CHECK(elapsedMs(start) < 10);
+}
+
+// 远处挂着一个定时器、很久没推进(timerfd布置在远处)，这时再挂近的：推进跳过中间空着的一段
+static void testIdleWithFarTimer()
+{
+    TimerWheel wheel;
+    TimerNode far, near;
+    std::vector<TimerNode*> expired;
+    uint64_t now = 0;
+    wheel.init(now);
+    wheel.add(&far, now + 10 * 86400000ULL, now);
+    now += 86400000ULL;
+    wheel.add(&near, now + 500, now);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    wheel.advance(now + 500, expired);
+    CHECK(expired.size() == 1 && expired[0] == &near);
+    CHECK(elapsedMs(start) < 10);
+    CHECK(wheel.nextExpire() > now + 500);
+    wheel.advance(10 * 86400000ULL - 1, expired);
+    CHECK(expired.size() == 1);
+    wheel.advance(10 * 86400000ULL, expired);
+    CHECK(expired.size() == 2 && expired[1] == &far);
+}
+
+// 随机挂上、刷新、摘下，时间按nextExpire跳或者随机往前走，到期的结点和时刻都要和参照模型一致
+static void testRandom()
+{
+    std::mt19937_64 rng(1);
+    const int N = 2000;
+    TimerWheel wheel;
+    std::vector<TimerNode> nodes(N);
+    std::vector<uint64_t> want(N, 0);  // 参照模型：每个结点的到期时间，0表示没挂着
+    std::vector<TimerNode*> expired;
+    uint64_t now = 123456;
+    wheel.init(now);
+    for (int step = 0; step < 100000; ++step)
+    {
+        int i = rng() % N;
+        if (rng() % 4 != 0)
+        {
+            uint64_t r = rng() % 8;
+            uint64_t d = r < 5 ? rng() % 600 : r < 7 ? rng() % 300000 : rng() % (1ULL << 31);
+            wheel.add(&nodes[i], now + d, now);
+            want[i] = d > 0 ? now + d : now + 1;
+        }
+        else
+        {
+            wheel.remove(&nodes[i]);
+            want[i] = 0;
+        }
+        uint64_t earliest = TIMER_NEVER;
+        size_t live = 0;
+        for (int k = 0; k < N; ++k)
+        {
+            if (want[k])
+            {
+                ++live;
+                if (want[k] < earliest)
+                    earliest = want[k];
+            }
+        }
+        CHECK(wheel.size() == live);
+        CHECK(wheel.nextExpire() <= earliest && wheel.nextExpire() > now);
+        if (rng() % 3 == 0 && earliest != TIMER_NEVER)
+            now = wheel.nextExpire();
+        else
+            now += rng() % 50 + (rng() % 500 == 0 ? rng() % 100000000 : 0);
+        expired.clear();
+        wheel.advance(now, expired);
+        for (TimerNode *node : expired)
+        {
+            int k = node - &nodes[0];
+            CHECK(want[k] != 0 && want[k] <= now);
+            want[k] = 0;
+        }
+        for (int k = 0; k < N; ++k)
+        {
+            if (want[k] && want[k] <= now)
+            {
+                CHECK(!"timer not expired");
+                want[k] = 0;
+                wheel.remove(&nodes[k]);
+            }
+        }
+        if (failures > 10)
+            return;
+    }
+}
+
+int main()
+{
+    testIdleThenAdd();
+    testIdleWithFarTimer();
+    testRandom();
+    printf("timer_wheel_test: %s\n", failures == 0 ? "ok" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
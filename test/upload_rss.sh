@@ -0,0 +1,31 @@
+#!/bin/bash
+# 上传一个大的multipart文件(没有--upload-dir，part直接丢掉)，服务器的内存峰值(VmHWM)不能跟着请求体涨。
+# 输入缓冲区读满就扩容、不先交给解析的话，整个请求体会先堆在缓冲区里
+# 用法: ./upload_rss.sh [MB]   需要先在上级目录make出myserver
+cd "$(dirname "$0")"
+SERVER=${SERVER:-../myserver}
+PORT=${PORT:-8897}
+ROOT=${ROOT:-../websource}
+MB=${1:-400}
+LIMIT_KB=${LIMIT_KB:-32768}     # 峰值超过32MB算失败，正常只比空闲时多几百KB
+FILE=/tmp/upload_rss_$MB.bin
+
+[ -f $FILE ] || truncate -s ${MB}M $FILE
+
+fail=0
+for mode in "" "--reactors 2"; do
+    $SERVER $PORT $ROOT $mode > /dev/null 2>&1 &
+    pid=$!
+    sleep 0.5
+    code=$(curl -s -m 120 -o /dev/null -w "%{http_code}" -F "file=@$FILE;filename=upload.bin" http://127.0.0.1:$PORT/)
+    hwm=$(awk '/VmHWM/ { print $2 }' /proc/$pid/status)
+    kill $pid
+    wait $pid 2>/dev/null || true
+    if [ "$code" = 200 ] && [ "$hwm" -lt $LIMIT_KB ]; then
+        echo "[$mode] ${MB}MB upload: ok (peak ${hwm}kB)"
+    else
+        echo "[$mode] ${MB}MB upload: FAIL (status $code, peak ${hwm}kB)"
+        fail=1
+    fi
+done
+exit $fail
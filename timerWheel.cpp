@@ -0,0 +1,156 @@
+#include "timerWheel.h"
+
+TimerWheel::TimerWheel():
+    current(0),
+    count(0)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        for (int i = 0; i < TIMER_WHEEL_SLOTS; ++i)
+        {
+            TimerNode *head = &slots[level][i];
+            head->prev = head;
+            head->next = head;
+        }
+    }
+}
+
+void TimerWheel::init(uint64_t now)
+{
+    current = now;
+}
+
+// 离到期还差delta毫秒，放在delta < 64^(level+1)的最低一层，槽号取到期时间在这一层的那几位
+void TimerWheel::link(TimerNode *node)
+{
+    uint64_t delta = node->expire - current;
+    uint64_t when = node->expire;
+    if (delta >= TIMER_WHEEL_RANGE) // 太远了，先放在最高层能表示的最远处，到时候再重新分配
+    {
+        delta = TIMER_WHEEL_RANGE - 1;
+        when = current + delta;
+    }
+    int level = 0;
+    while (delta >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))))
+        ++level;
+    TimerNode *head = &slots[level][(when >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::unlink(TimerNode *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+void TimerWheel::add(TimerNode *node, uint64_t expire, uint64_t now)
+{
+    if (node->linked())
+    {
+        unlink(node);
+        --count;
+    }
+    if (count == 0 && now > current)
+        current = now;
+    ++count;
+    // current及以前的都已经处理过了，已经到期的放到下一毫秒
+    node->expire = expire > current ? expire : current + 1;
+    link(node);
+}
+
+void TimerWheel::remove(TimerNode *node)
+{
+    if (!node->linked())
+        return;
+    unlink(node);
+    --count;
+}
+
+// 高层槽里的结点到期时间都不早于current，重新分配时会落到更低的层
+void TimerWheel::cascade(int level)
+{
+    TimerNode *head = &slots[level][(current >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    TimerNode *node = head->next;
+    head->prev = head;
+    head->next = head;
+    while (node != head)
+    {
+        TimerNode *next = node->next;
+        link(node);
+        node = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<TimerNode*> &expired)
+{
+    if (count == 0) // 没有定时器，不用一毫秒一毫秒地走
+    {
+        if (now > current)
+            current = now;
+        return;
+    }
+    while (current < now)
+    {
+        uint64_t next = nextExpire();
+        if (next > now) // 到now为止什么都不用做
+        {
+            current = now;
+            break;
+        }
+        current = next;
+        // 低层转完一圈，从高一层的当前槽补进来；这一层也转完一圈就接着往上
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+        {
+            if ((current & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+        TimerNode *head = &slots[0][current & (TIMER_WHEEL_SLOTS - 1)];
+        while (head->next != head)
+        {
+            TimerNode *node = head->next;
+            unlink(node);
+            --count;
+            expired.push_back(node);
+        }
+    }
+}
+
+// 第0层只放current之后64毫秒内到期的，往后找第一个非空槽；第l层的槽在时间走到它的起点时往下分配，找第一个非空槽的起点
+uint64_t TimerWheel::nextExpire() const
+{
+    if (count == 0)
+        return TIMER_NEVER;
+    uint64_t next = TIMER_NEVER;
+    for (int i = 1; i < TIMER_WHEEL_SLOTS; ++i)
+    {
+        const TimerNode *head = &slots[0][(current + i) & (TIMER_WHEEL_SLOTS - 1)];
+        if (head->next != head)
+        {
+            next = current + i;
+            break;
+        }
+    }
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        int shift = TIMER_WHEEL_BITS * level;
+        for (int i = 1; i <= TIMER_WHEEL_SLOTS; ++i)
+        {
+            uint64_t start = ((current >> shift) + i) << shift;
+            if (start >= next)
+                break;
+            const TimerNode *head = &slots[level][(start >> shift) & (TIMER_WHEEL_SLOTS - 1)];
+            if (head->next != head)
+            {
+                next = start;
+                break;
+            }
+        }
+    }
+    return next;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+const int TIMER_WHEEL_BITS = 6;                         // 每层的槽数取2的幂，一层64个槽
+const int TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS;
+const int TIMER_WHEEL_LEVELS = 5;                       // 第0层每槽1毫秒，往上每层粗64倍，5层能表示约12天
+const uint64_t TIMER_WHEEL_RANGE = (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+const uint64_t TIMER_NEVER = UINT64_MAX;
+
+/* 嵌在拥有者(连接)里的定时器结点。挂在时间轮某个槽的双向链表上，prev为NULL表示没挂着；
+   同一个结点反复挂上、摘下，刷新超时时间不用分配内存 */
+struct TimerNode
+{
+    TimerNode *prev;
+    TimerNode *next;
+    uint64_t expire;    // 到期时间，毫秒
+    void *owner;        // 结点所属的对象，到期时交还给调用者
+
+    explicit TimerNode(void *_owner = NULL): prev(NULL), next(NULL), expire(0), owner(_owner) {}
+    bool linked() const { return prev != NULL; }
+};
+
+/* 分层时间轮。第0层按毫秒分槽，离到期越远放在越高层、越粗的槽里，时间走到高层槽的起点时把整槽的结点往下层重新分配，
+   加入、删除、刷新都是O(1)的链表操作，到期时只看当前那一个槽；挂着的结点数就是活着的定时器数，没有删了还留着的墓碑。
+   本身不加锁，由调用者保证互斥 */
+class TimerWheel
+{
+private:
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];    // 每个槽一个哨兵结点，链表首尾相连
+    uint64_t current;   // 已经处理到的时刻(毫秒)，到期时间不晚于它的结点都已经取出
+    size_t count;       // 挂着的结点数
+
+    void link(TimerNode *node);     // 按node->expire和current放进对应层的槽
+    static void unlink(TimerNode *node);
+    void cascade(int level);        // 把level层当前的槽整个往下层重新分配
+
+public:
+    TimerWheel();
+    void init(uint64_t now);
+    /* 已经挂着的先摘下来再按新的时间挂上。now是调用者读到的当前时间：时间轮空着时没人推进current，
+       它可能还停在很久以前，先跳到now，结点才会放进离现在最近的槽里 */
+    void add(TimerNode *node, uint64_t expire, uint64_t now);
+    void remove(TimerNode *node);                   // 没挂着就什么都不做
+    /* 时间走到now，到期的结点摘下来放进expired(追加)，之后可以再次add。
+       中间没有结点到期、也没有槽要往下分配的一段直接跳过，停了很久再推进也不用一毫秒一毫秒地走 */
+    void advance(uint64_t now, std::vector<TimerNode*> &expired);
+    /* 下一次要醒来的时刻：第0层最近的非空槽，或者更早的高层槽往下分配的时刻，不晚于最早的到期时间；
+       醒来时可能什么都没到期，只是分配了一次。没有定时器返回TIMER_NEVER */
+    uint64_t nextExpire() const;
+    size_t size() const { return count; }
+};
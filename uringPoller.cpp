@@ -0,0 +1,619 @@
+#include "uringPoller.h"
+#include "util.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+const unsigned URING_SQ_ENTRIES = 1024;
+const unsigned URING_CQ_ENTRIES = 8192;
+const unsigned URING_BUF_COUNT = 1024; // provided buffer个数
+const unsigned URING_BUF_SIZE = 4096;  // 每个provided buffer的大小，与连接一次read的大小相同
+const size_t URING_SEND_IOV_MAX = 64;  // 一个sendmsg最多合并的块数
+
+UringPoller::UringPoller():
+    ring_fd(-1),
+    sq_entries(0),
+    cq_entries(0),
+    sq_ptr(NULL),
+    cq_ptr(NULL),
+    sq_size(0),
+    cq_size(0),
+    sqes(NULL),
+    sq_local_tail(0),
+    sq_submitted(0),
+    ext_arg(false),
+    buf_base(NULL),
+    buf_count(0),
+    buf_size(0)
+{
+}
+
+UringPoller::~UringPoller()
+{
+    if (buf_base)
+        munmap(buf_base, buf_count * buf_size);
+    if (sqes)
+        munmap(sqes, sq_entries * sizeof(io_uring_sqe));
+    if (cq_ptr && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr)
+        munmap(sq_ptr, sq_size);
+    if (ring_fd >= 0)
+        ::close(ring_fd);
+}
+
+// 创建ring，映射SQ/CQ，并提供接收缓冲区
+int UringPoller::init(int maxevents, int listen_num)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = URING_CQ_ENTRIES;
+    ring_fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p);
+    if (ring_fd < 0 && errno == EINVAL) // 老内核不支持COOP_TASKRUN
+    {
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = URING_CQ_ENTRIES;
+        ring_fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p);
+    }
+    if (ring_fd < 0)
+        return -1;
+    sq_entries = p.sq_entries;
+    cq_entries = p.cq_entries;
+    ext_arg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        if (cq_size > sq_size)
+            sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+    {
+        sq_ptr = NULL;
+        return -1;
+    }
+    if (single_mmap)
+        cq_ptr = sq_ptr;
+    else
+    {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+        {
+            cq_ptr = NULL;
+            return -1;
+        }
+    }
+    void *sqe_ptr = mmap(NULL, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqe_ptr == MAP_FAILED)
+        return -1;
+    sqes = static_cast<io_uring_sqe*>(sqe_ptr);
+
+    char *sq = static_cast<char*>(sq_ptr);
+    char *cq = static_cast<char*>(cq_ptr);
+    sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    sq_local_tail = sq_submitted = *sq_tail;
+
+    /* provided buffers：内核收到数据时自己挑一个空闲缓冲区填进去。
+       没有用IORING_REGISTER_PBUF_RING注册的buffer ring：部分内核上注册成功但recv始终拿不到缓冲区(ENOBUFS)，
+       IORING_OP_PROVIDE_BUFFERS支持的内核更多，归还缓冲区的sqe也和其他请求一起在下一次io_uring_enter里提交 */
+    buf_count = URING_BUF_COUNT;
+    buf_size = URING_BUF_SIZE;
+    void *base = mmap(NULL, buf_count * buf_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (base == MAP_FAILED)
+        return -1;
+    buf_base = static_cast<char*>(base);
+    prepProvide(0, buf_count);
+
+    conns.resize(maxOpenFiles());
+    max_events = maxevents;
+    events = new PollEvent[maxevents];
+    return 0;
+}
+
+// 取一个空闲sqe，SQ满了先提交一次
+io_uring_sqe *UringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries)
+    {
+        submit(0, 0);
+        head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sq_local_tail - head >= sq_entries)
+            return NULL;
+    }
+    unsigned idx = sq_local_tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    ++sq_local_tail;
+    return sqe;
+}
+
+// 把填好的sqe交给内核，wait_nr>0时顺便等待完成事件，timeout<0表示一直等
+int UringPoller::submit(unsigned wait_nr, int timeout)
+{
+    unsigned to_submit = sq_local_tail - sq_submitted;
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    sq_submitted = sq_local_tail;
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    if (wait_nr > 0 && timeout >= 0 && ext_arg)
+    {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)&ts;
+        ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    else
+        ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, NULL, 0);
+    if (ret < 0 && errno != ETIME && errno != EINTR)
+    {
+        perror("io_uring_enter error");
+        return -1;
+    }
+    return 0;
+}
+
+// user_data: 低4位操作类型，4~35位fd，36位以上是gen的低28位，用于识别fd被复用后的旧完成事件
+uint64_t UringPoller::makeData(int fd, uint64_t token, int op)
+{
+    return (((token >> 32) & 0x0FFFFFFFULL) << 36) | ((uint64_t)(uint32_t)fd << 4) | (uint64_t)op;
+}
+
+void UringPoller::prepRecv(int fd)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = makeData(fd, conns[fd].token, OP_RECV);
+}
+
+void UringPoller::prepAccept(int fd)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = makeData(fd, conns[fd].token, OP_ACCEPT);
+}
+
+// 把从bid开始的nbufs个缓冲区交给内核
+void UringPoller::prepProvide(int bid, unsigned nbufs)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = nbufs;
+    sqe->addr = (uint64_t)(buf_base + (size_t)bid * buf_size);
+    sqe->len = buf_size;
+    sqe->off = bid;
+    sqe->buf_group = 0;
+    sqe->user_data = OP_PROVIDE;
+}
+
+void UringPoller::prepPoll(int fd)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = makeData(fd, conns[fd].token, OP_POLL);
+}
+
+unsigned UringPoller::sqRoom() const
+{
+    return sq_entries - (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+}
+
+/* shutdown + close，如果前一个sqe设了IOSQE_IO_LINK，它们会在前面的send全部成功后才执行。
+   两个sqe要先一起占好位置：只放进去带IOSQE_IO_LINK的SHUTDOWN而CLOSE放不进去的话，fd和它的槽位就永远不会释放。
+   链在前面的调用者已经为这两个留了位置，这里提交一次还放不下时前面不会有挂着的链，直接同步关闭 */
+void UringPoller::prepClose(int fd)
+{
+    if (sqRoom() < 2)
+        submit(0, 0);
+    if (sqRoom() < 2)
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = fd;
+    sqe->len = SHUT_RDWR; // 同时结束该fd上的多发recv
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = makeData(fd, conns[fd].token, OP_SHUTDOWN);
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = makeData(fd, conns[fd].token, OP_CLOSE);
+}
+
+// 把chunks串成一条send链提交，链内按顺序执行，前一个失败后面的都会被取消
+void UringPoller::submitChain(int fd, std::deque<OutChunk> &chunks, bool close_after)
+{
+    UringConn &c = conns[fd];
+    // 整条链要在同一次io_uring_enter里提交，先保证SQ有足够空位
+    unsigned room = sqRoom();
+    if (room < chunks.size() + 2)
+    {
+        submit(0, 0);
+        room = sqRoom();
+    }
+    size_t max_send = room > 2 ? room - 2 : 0;
+    io_uring_sqe *sqe = NULL;
+    SendOp *last_op = NULL;
+    while (!chunks.empty() && max_send > 0)
+    {
+        io_uring_sqe *s = getSqe();
+        if (!s)
+            break;
+        SendOp *op = new SendOp();
+        op->fd = fd;
+        op->token = c.token;
+        op->last = false;
+        op->len = 0;
+        // 状态行、头部和正文等连续的块合并成一个sendmsg，一次发出
+        while (!chunks.empty() && op->chunks.size() < URING_SEND_IOV_MAX)
+        {
+            op->chunks.push_back(chunks.front());
+            chunks.pop_front();
+            struct iovec v;
+            v.iov_base = const_cast<char*>(op->chunks.back().data);
+            v.iov_len = op->chunks.back().len;
+            op->iov.push_back(v);
+            op->len += v.iov_len;
+        }
+        s->fd = fd;
+        if (op->chunks.size() == 1)
+        {
+            s->opcode = IORING_OP_SEND;
+            s->addr = (uint64_t)op->iov[0].iov_base;
+            s->len = op->iov[0].iov_len;
+        }
+        else
+        {
+            memset(&op->msg, 0, sizeof(op->msg));
+            op->msg.msg_iov = op->iov.data();
+            op->msg.msg_iovlen = op->iov.size();
+            s->opcode = IORING_OP_SENDMSG;
+            s->addr = (uint64_t)&op->msg;
+            s->len = 1;
+        }
+        s->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; // 短写由内核继续重试，只有出错才会返回不足
+        s->flags = IOSQE_IO_LINK;
+        s->user_data = (uint64_t)op;
+        sqe = s;
+        last_op = op;
+        --max_send;
+    }
+    if (!chunks.empty()) // SQ放不下的留到这条链结束后再发，close也只能等到那时
+    {
+        if (&chunks != &c.waiting)
+            c.waiting.insert(c.waiting.end(), chunks.begin(), chunks.end());
+        chunks.clear();
+        if (close_after)
+            c.close_pending = true;
+        close_after = false;
+    }
+    if (last_op)
+    {
+        last_op->last = true;
+        c.sending = true;
+    }
+    if (close_after)
+    {
+        prepClose(fd);
+        c.tail_sqe = NULL;
+        return;
+    }
+    if (sqe)
+        sqe->flags &= ~IOSQE_IO_LINK;
+    c.tail_sqe = sqe;
+    c.tail_index = sq_local_tail;
+}
+
+void UringPoller::handleSendDone(SendOp *op, int res)
+{
+    UringConn &c = conns[op->fd];
+    bool same = c.token == op->token;
+    if (same && (res < 0 || (size_t)res < op->len)) // 发送失败，连接已不可用，后面排队的响应不用再发了
+        c.waiting.clear();
+    if (same && op->last)
+    {
+        c.sending = false;
+        if (!c.waiting.empty() || c.close_pending)
+        {
+            bool close_after = c.close_pending;
+            c.close_pending = false;
+            submitChain(op->fd, c.waiting, close_after);
+        }
+    }
+    delete op;
+}
+
+int UringPoller::add(int fd, uint64_t token, __uint32_t events)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+        return -1;
+    conns[fd] = UringConn();
+    conns[fd].token = token;
+    conns[fd].live = true;
+    prepPoll(fd);
+    return 0;
+}
+
+int UringPoller::addConn(int fd, uint64_t token, __uint32_t events)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+        return -1;
+    conns[fd] = UringConn();
+    conns[fd].token = token;
+    conns[fd].live = true;
+    prepRecv(fd);
+    return 0;
+}
+
+int UringPoller::addListener(int fd, uint64_t token)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+        return -1;
+    conns[fd] = UringConn();
+    conns[fd].token = token;
+    conns[fd].live = true;
+    conns[fd].listener = true;
+    prepAccept(fd);
+    return 0;
+}
+
+// 多发recv一直有效，不需要像EPOLLONESHOT那样重新布置
+int UringPoller::mod(int fd, uint64_t token, __uint32_t events)
+{
+    return 0;
+}
+
+// 下树只做标记，多发recv由随后的close(shutdown)结束
+int UringPoller::del(int fd, uint64_t token)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+        return -1;
+    conns[fd].live = false;
+    return 0;
+}
+
+int UringPoller::poll(int timeout)
+{
+    for (int fd : rearm_fds) // 缓冲区已归还，重新提交中止的多发recv
+    {
+        if (conns[fd].live)
+            prepRecv(fd);
+    }
+    rearm_fds.clear();
+
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        submit(timeout == 0 ? 0 : 1, timeout);
+    else if (sq_local_tail != sq_submitted)
+        submit(0, 0);
+
+    int n = 0;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && n < max_events)
+    {
+        io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        uint64_t data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        ++head;
+        int op = data & 0xF;
+        if (op == OP_SEND)
+        {
+            handleSendDone(reinterpret_cast<SendOp*>(data), res);
+            continue;
+        }
+        int fd = (int)((data >> 4) & 0xFFFFFFFFULL);
+        UringConn &c = conns[fd];
+        bool valid = c.live && (((c.token >> 32) & 0x0FFFFFFFULL) == (data >> 36));
+        bool more = (flags & IORING_CQE_F_MORE) != 0;
+        PollEvent &ev = events[n];
+        ev.token = c.token;
+        ev.events = EPOLLIN;
+        ev.accept_fd = -1;
+        ev.data = NULL;
+        ev.len = 0;
+        ev.buf_id = -1;
+        switch (op)
+        {
+            case OP_ACCEPT:
+            {
+                if (res >= 0)
+                {
+                    if (valid)
+                    {
+                        ev.accept_fd = res;
+                        ++n;
+                    }
+                    else
+                        ::close(res);
+                }
+                if (!more && valid)
+                    prepAccept(fd);
+                break;
+            }
+            case OP_RECV:
+            {
+                if (res > 0)
+                {
+                    int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                    if (valid)
+                    {
+                        ev.data = buf_base + (size_t)bid * buf_size;
+                        ev.len = res;
+                        ev.buf_id = bid;
+                        ++n;
+                    }
+                    else
+                    {
+                        ev.buf_id = bid;
+                        release(ev);
+                        ev.buf_id = -1;
+                    }
+                    if (!more && valid)
+                        rearm_fds.push_back(fd);
+                }
+                else if (res == -ENOBUFS) // 缓冲区暂时用完，等归还后再提交
+                {
+                    if (valid)
+                        rearm_fds.push_back(fd);
+                }
+                else if (valid) // 0是对端关闭，负数是出错
+                {
+                    ev.events = res == 0 ? (EPOLLIN | EPOLLRDHUP | EPOLLHUP) : EPOLLERR;
+                    ++n;
+                }
+                break;
+            }
+            case OP_POLL:
+            {
+                if (res > 0 && valid)
+                    ++n;
+                if (!more && valid)
+                    prepPoll(fd);
+                break;
+            }
+            case OP_CLOSE:
+            {
+                if (res == -ECANCELED) // 前面的send失败导致链被取消，直接同步关闭
+                {
+                    ::shutdown(fd, SHUT_RDWR);
+                    ::close(fd);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+// 把provided buffer还给内核
+void UringPoller::release(const PollEvent &ev)
+{
+    if (ev.buf_id < 0)
+        return;
+    prepProvide(ev.buf_id, 1);
+}
+
+/* ring里没有sendfile，文件数据映射成内存再走send链。映射区由新块的owner负责解除，
+   同时持有原来的owner(打开的文件)；单个send的长度是32位的，大文件按URING_MAP_MAX分段映射 */
+static int mapFileChunks(std::deque<OutChunk> &chunks)
+{
+    const size_t URING_MAP_MAX = 1 << 30;
+    std::deque<OutChunk> mapped;
+    for (auto &chunk : chunks)
+    {
+        if (chunk.data)
+        {
+            mapped.push_back(chunk);
+            continue;
+        }
+        while (chunk.len > 0)
+        {
+            size_t len = chunk.len < URING_MAP_MAX ? chunk.len : URING_MAP_MAX;
+            off_t page_off = chunk.file_off & ~(off_t)(sysconf(_SC_PAGESIZE) - 1); // mmap偏移要按页对齐
+            size_t map_len = len + (chunk.file_off - page_off);
+            void *addr = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, chunk.file_fd, page_off);
+            if (addr == MAP_FAILED)
+                return -1;
+            std::shared_ptr<void> file_owner = chunk.owner;
+            OutChunk piece;
+            piece.data = static_cast<char*>(addr) + (chunk.file_off - page_off);
+            piece.len = len;
+            piece.owner = std::shared_ptr<void>(addr, [map_len, file_owner](void *p) { munmap(p, map_len); });
+            mapped.push_back(piece);
+            chunk.file_off += len;
+            chunk.len -= len;
+        }
+    }
+    chunks.swap(mapped);
+    return 0;
+}
+
+// 同一连接同时只有一条send链在内核里，否则两条链可能交错写进socket
+int UringPoller::send(int fd, uint64_t token, std::deque<OutChunk> &chunks)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+        return -1;
+    if (mapFileChunks(chunks) < 0)
+        return -1;
+    UringConn &c = conns[fd];
+    if (c.sending || !c.waiting.empty())
+    {
+        c.waiting.insert(c.waiting.end(), chunks.begin(), chunks.end());
+        chunks.clear();
+        return 0;
+    }
+    submitChain(fd, chunks, false);
+    return 0;
+}
+
+// 关闭连接：如果本连接的send链还没交给内核，直接把shutdown/close链接在后面；
+// send链已在内核里就等它结束；否则立即提交
+void UringPoller::close(int fd)
+{
+    if (fd < 0 || (size_t)fd >= conns.size())
+    {
+        ::close(fd);
+        return;
+    }
+    UringConn &c = conns[fd];
+    c.live = false;
+    // 接在还没提交的send链后面要两个空位，不够时等链发完再关，免得为了腾位置把半条链先提交出去
+    if (c.tail_sqe && c.waiting.empty() && c.tail_index == sq_local_tail && c.tail_index > sq_submitted && sqRoom() >= 2)
+    {
+        c.tail_sqe->flags |= IOSQE_IO_LINK;
+        c.tail_sqe = NULL;
+        prepClose(fd);
+    }
+    else if (c.sending)
+        c.close_pending = true;
+    else
+        prepClose(fd);
+}
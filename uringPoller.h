@@ -0,0 +1,99 @@
+#pragma once
+
+#include "poller.h"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+/* io_uring后端，直接用io_uring_setup/io_uring_enter系统调用，不依赖liburing。
+   监听fd用多发accept，连接fd用多发recv + provided buffers，数据到达时已经在缓冲区里；
+   响应按连接串成链式send提交，连接关闭时在send链后接上shutdown/close；eventfd等一般fd用多发poll。
+   提交和收割都合并在每轮的一次io_uring_enter里，一个长连接请求基本不再需要单独的系统调用 */
+class UringPoller : public Poller
+{
+private:
+    // user_data低4位是操作类型，为0时整个user_data是SendOp指针
+    enum { OP_SEND = 0, OP_ACCEPT = 1, OP_RECV = 2, OP_POLL = 3, OP_SHUTDOWN = 4, OP_CLOSE = 5, OP_PROVIDE = 6 };
+
+    // 一个send或sendmsg请求，连续的几块响应合并成一个sendmsg
+    struct SendOp
+    {
+        std::vector<OutChunk> chunks;
+        std::vector<struct iovec> iov;
+        struct msghdr msg;
+        size_t len;         // 这个请求要发送的总字节数
+        int fd;
+        uint64_t token;
+        bool last;          // 是否是这条send链的最后一个send
+    };
+
+    // 每个fd在ring里的状态
+    struct UringConn
+    {
+        uint64_t token;
+        bool live;          // 仍在上树状态，多发操作结束后可以重新提交
+        bool listener;
+        bool sending;       // 有send链在内核里
+        bool close_pending; // send链结束后要关闭
+        std::deque<OutChunk> waiting; // send链在途时新来的响应
+        io_uring_sqe *tail_sqe;       // 本连接最后提交的、尚未进入内核的sqe，用来把close链接到send后面
+        unsigned tail_index;
+        UringConn(): token(0), live(false), listener(false), sending(false), close_pending(false), tail_sqe(NULL), tail_index(0) {}
+    };
+
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned cq_entries;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    io_uring_sqe *sqes;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+    unsigned sq_local_tail;     // 已填好但还没提交给内核的sqe尾部
+    unsigned sq_submitted;
+    bool ext_arg;
+
+    // provided buffers，内核收到数据时自己从这组缓冲区里挑一个填进去
+    char *buf_base;
+    unsigned buf_count;
+    unsigned buf_size;
+
+    std::vector<UringConn> conns;   // 下标是fd
+    std::vector<int> rearm_fds;     // 多发recv因缓冲区用完而中止，归还缓冲区后重新提交
+
+    io_uring_sqe *getSqe();
+    unsigned sqRoom() const;    // SQ里还能放几个sqe
+    int submit(unsigned wait_nr, int timeout);
+    static uint64_t makeData(int fd, uint64_t token, int op);
+    void prepRecv(int fd);
+    void prepAccept(int fd);
+    void prepPoll(int fd);
+    void prepProvide(int bid, unsigned nbufs);
+    void submitChain(int fd, std::deque<OutChunk> &chunks, bool close_after);
+    void prepClose(int fd);
+    void handleSendDone(SendOp *op, int res);
+
+public:
+    UringPoller();
+    ~UringPoller();
+    int init(int maxevents, int listen_num) override;
+    int add(int fd, uint64_t token, __uint32_t events) override;
+    int addConn(int fd, uint64_t token, __uint32_t events) override;
+    int addListener(int fd, uint64_t token) override;
+    int mod(int fd, uint64_t token, __uint32_t events) override;
+    int del(int fd, uint64_t token) override;
+    int poll(int timeout) override;
+    void release(const PollEvent &ev) override;
+    int send(int fd, uint64_t token, std::deque<OutChunk> &chunks) override;
+    void close(int fd) override;
+    bool ownsIO() const override { return true; }
+};
@@ -1,9 +1,12 @@
 #include "util.h"
+#include <sched.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 // 从fd中读取指定长度n的数据到buff中
 ssize_t readn(int fd, void *buff, size_t n)
@@ -36,7 +39,7 @@ ssize_t readn(int fd, void *buff, size_t n)
     return readSum;
 }
 
-// 同样非阻塞循环写入
+// 同样非阻塞循环写入，socket发送缓冲区满(EAGAIN)时不再原地空转，返回已写入的字节数，剩下的等EPOLLOUT再写
 ssize_t writen(int fd, void *buff, size_t n)
 {
     size_t nleft = n;
@@ -49,11 +52,13 @@ ssize_t writen(int fd, void *buff, size_t n)
         {
             if (nwritten < 0)
             {
-                if (errno == EINTR || errno == EAGAIN)
+                if (errno == EINTR)
                 {
                     nwritten = 0;
                     continue;
                 }
+                else if (errno == EAGAIN)
+                    return writeSum;
                 else
                     return -1;
             }
@@ -88,4 +93,107 @@ int setSocketNonBlocking(int fd)
     if(fcntl(fd, F_SETFL, flag) == -1)
         return -1;
     return 0;
-}
\ No newline at end of file
+}
+
+/* 把当前进程绑定到一组CPU核上，减少跨核迁移带来的缓存失效。
+   只在sched_getaffinity允许的核(cgroup/taskset限制后的)里挑：按顺序平均分成count份，取第index份，
+   份数比核多时几份共用一个核。要在创建线程之前调用，之后建的线程池和子reactor线程都继承这一组核，
+   所以每份不止一个核时它们仍能分开跑 */
+int bindToCpuShare(int index, int count)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return -1;
+    int cpus[CPU_SETSIZE];
+    int cpu_num = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+            cpus[cpu_num++] = cpu;
+    }
+    if (cpu_num == 0 || count <= 0)
+        return -1;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (count >= cpu_num)
+        CPU_SET(cpus[index % cpu_num], &mask);
+    else
+    {
+        for (int i = index * cpu_num / count; i < (index + 1) * cpu_num / count; ++i)
+            CPU_SET(cpus[i], &mask);
+    }
+    if (sched_setaffinity(0, sizeof(mask), &mask) == -1)
+        return -1;
+    return 0;
+}
+
+// 进程能打开的最大fd数(RLIMIT_NOFILE)，用来预分配按fd下标寻址的表，最多1<<20
+size_t maxOpenFiles()
+{
+    const size_t MAX_FD_SLOTS = 1 << 20;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t)MAX_FD_SLOTS)
+        return rl.rlim_cur;
+    return MAX_FD_SLOTS;
+}
+
+// 把时间格式化成HTTP日期，如 Sun, 06 Nov 1994 08:49:37 GMT
+std::string httpDate(time_t t)
+{
+    struct tm tm_buf;
+    gmtime_r(&t, &tm_buf);
+    char buff[64];
+    strftime(buff, sizeof(buff), "%a, %d %b %Y %H:%M:%S GMT", &tm_buf);
+    return buff;
+}
+
+// 当前时间的HTTP日期，每个线程每秒只格式化一次，返回的引用到本线程下次调用前有效
+const std::string &httpDateNow()
+{
+    static thread_local time_t last = -1;
+    static thread_local std::string date;
+    time_t now = time(NULL);
+    if (now != last)
+    {
+        date = httpDate(now);
+        last = now;
+    }
+    return date;
+}
+
+// 按/分段，任何一段是空的(开头、结尾或连续的/)、.或..都不算规范
+bool canonicalPath(std::string_view path)
+{
+    if (path.empty())
+        return false;
+    size_t pos = 0;
+    while (pos <= path.size())
+    {
+        size_t end = path.find('/', pos);
+        if (end == std::string_view::npos)
+            end = path.size();
+        size_t len = end - pos;
+        if (len == 0 || (len == 1 && path[pos] == '.') || (len == 2 && path[pos] == '.' && path[pos + 1] == '.'))
+            return false;
+        pos = end + 1;
+    }
+    return true;
+}
+
+// 只认httpDate输出的格式(IMF-fixdate)，RFC 850和asctime这两种旧格式当作不认识
+time_t parseHttpDate(const std::string &date)
+{
+    struct tm tm_buf;
+    memset(&tm_buf, 0, sizeof(tm_buf));
+    const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_buf);
+    if (end == NULL || *end != '\0')
+        return -1;
+    return timegm(&tm_buf);
+}
+
+uint64_t monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
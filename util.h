@@ -1,8 +1,19 @@
 #pragma once
 
 #include <cstdlib>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <time.h>
 
 ssize_t readn(int fd, void *buff, size_t n);
 ssize_t writen(int fd, void *buff, size_t n);
 void handle_for_sigpipe();
-int setSocketNonBlocking(int fd);
\ No newline at end of file
+int setSocketNonBlocking(int fd);
+int bindToCpuShare(int index, int count);  // 把允许的CPU分成count份，当前进程绑到第index份上
+size_t maxOpenFiles();
+std::string httpDate(time_t t);
+time_t parseHttpDate(const std::string &date);
+const std::string &httpDateNow();
+bool canonicalPath(std::string_view path); // 规范的相对路径：非空，没有空段、.和..
+uint64_t monotonicMs();     // CLOCK_MONOTONIC的毫秒数，定时器用，不受系统时间调整影响
\ No newline at end of file